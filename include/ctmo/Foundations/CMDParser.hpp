@@ -20,8 +20,8 @@ class CMDInfo
     CMDInfo(const CMDInfo &cmdInfo) = default;
 
     CMDInfo(const std::string &prefixIn, const int &iterIn, const std::string &suffixIn, const bool &doSCIn = false,
-            const bool &exitFromCMDIn = false)
-        : fnamePrefix_(prefixIn), iter_(iterIn), fnameSuffix_(suffixIn), doSC_(doSCIn), exitFromCMD_(exitFromCMDIn)
+            const bool &exitFromCMDIn = false, const bool &restartIn = false)
+        : fnamePrefix_(prefixIn), iter_(iterIn), fnameSuffix_(suffixIn), doSC_(doSCIn), exitFromCMD_(exitFromCMDIn), restart_(restartIn)
     {
     }
 
@@ -33,6 +33,7 @@ class CMDInfo
     std::string fnameSuffix() const { return fnameSuffix_; }
     bool doSC() const { return doSC_; }
     bool exitFromCMD() const { return exitFromCMD_; }
+    bool restart() const { return restart_; }
 
   private:
     std::string fnamePrefix_{""};
@@ -40,6 +41,7 @@ class CMDInfo
     std::string fnameSuffix_{""};
     bool doSC_{true};
     bool exitFromCMD_{false};
+    bool restart_{false};
 };
 
 CMDInfo GetProgramOptions(int argc, char **argv)
@@ -51,7 +53,8 @@ CMDInfo GetProgramOptions(int argc, char **argv)
     po::options_description desc("Example usage: ctmo params1.json. \n\nAllowed Options:");
     desc.add_options()("help,h", "Print help messages.")("fname,f", po::value<std::string>()->required(),
                                                          "simulation filename (in json format).")(
-        "no-sc,n", "Don't perform the selfconsistency nor prepare the next iteration.");
+        "no-sc,n", "Don't perform the selfconsistency nor prepare the next iteration.")(
+        "restart,r", "Resume the measurements from the checkpoints of a killed run (see monteCarlo.checkpointTime).");
 
     po::positional_options_description positional;
     positional.add("fname", -1);
@@ -81,6 +84,7 @@ CMDInfo GetProgramOptions(int argc, char **argv)
     }
 
     cmdInfo.doSC_ = !vm.count("no-sc");
+    cmdInfo.restart_ = vm.count("restart");
     const std::string jsonFileName = vm["fname"].as<std::string>();
     // std::cout << "jsonFileName = " << jsonFileName << std::endl;
 
@@ -100,7 +104,7 @@ CMDInfo GetProgramOptions(int argc, char **argv)
         suffix = numberMatch.suffix();
     }
 
-    CMDInfo cmdInfoResult(prefix, iter, suffix, cmdInfo.doSC(), cmdInfo.exitFromCMD());
+    CMDInfo cmdInfoResult(prefix, iter, suffix, cmdInfo.doSC(), cmdInfo.exitFromCMD(), cmdInfo.restart());
 
     // std::cout << cmdInfoResult.fileName() << std::endl;
 
@@ -0,0 +1,222 @@
+#pragma once
+
+#include "ctmo/Foundations/LinAlg.hpp"
+
+namespace LinAlg
+{
+
+// Delayed version of BlockRankOneUpgrade and BlockRankOneDowngrade (see Gull CTQMC review, delayed updates).
+// The stored matrix B always has the current size, and the true inverse is N = B + U*Vt. Each accepted update
+// only appends one column to U and one row to Vt. Flush() adds U*Vt to B with a single DGEMM.
+// Only the rank-one update of B (dger) is delayed: each proposal still goes over B with a gemv for N*Q, and each accepted
+// insertion with another one for R*N, plus the two k x m gemvs of the correction. A step stays O(k^2) in memory bound
+// matrix-vector products, what is gained is the k^2 write of B per accepted update, replaced by one DGEMM every m updates.
+// T is the precision of B, U and Vt (float for the mixed precision N matrices), the vectors are always in double.
+template <typename T> class DelayedRankOneT
+{
+  public:
+    explicit DelayedRankOneT(const size_t &maxDelay = 0) : maxDelay_(maxDelay) {}
+
+    bool IsEnabled() const { return maxDelay_ > 1; }
+    bool IsFull() const { return nPending_ >= maxDelay_; }
+    size_t nPending() const { return nPending_; }
+    size_t maxDelay() const { return maxDelay_; }
+
+    // N(i, j) = B(i, j) + sum_l U(i, l) * Vt(l, j)
+    double Element(const Matrix<T> &B, const size_t &i, const size_t &j) const
+    {
+        double value = B(i, j);
+        for (size_t ll = 0; ll < nPending_; ll++)
+        {
+            value += U_(i, ll) * Vt_(ll, j);
+        }
+        return value;
+    }
+
+    // Y = N*X
+    void MatrixVectorMult(const Matrix<T> &B, const SiteVector_t &X, SiteVector_t &Y)
+    {
+        const unsigned int kk = B.n_rows();
+        const T *XT = AsPrecision(X, xT_);
+        T *YT = ResultMemory(Y, yT_);
+        Gemv('n', kk, kk, 1.0, B.memptr(), B.mem_n_rows(), XT, 0.0, YT);
+        if (static_cast<bool>(nPending_))
+        {
+            const unsigned int mm = nPending_;
+            T *tmp = tmp_.View(mm).memptr();
+            Gemv('n', mm, kk, 1.0, Vt_.memptr(), Vt_.mem_n_rows(), XT, 0.0, tmp); // tmp = Vt*X
+            Gemv('n', kk, mm, 1.0, U_.memptr(), U_.mem_n_rows(), tmp, 1.0, YT);   // Y += U*tmp
+        }
+        StoreResult(YT, Y);
+    }
+
+    // Y = X*N
+    void VectorMatrixMult(const SiteVector_t &X, const Matrix<T> &B, SiteVector_t &Y)
+    {
+        const unsigned int kk = B.n_rows();
+        const T *XT = AsPrecision(X, xT_);
+        T *YT = ResultMemory(Y, yT_);
+        Gemv('t', kk, kk, 1.0, B.memptr(), B.mem_n_rows(), XT, 0.0, YT);
+        if (static_cast<bool>(nPending_))
+        {
+            const unsigned int mm = nPending_;
+            T *tmp = tmp_.View(mm).memptr();
+            Gemv('t', kk, mm, 1.0, U_.memptr(), U_.mem_n_rows(), XT, 0.0, tmp);   // tmp = X*U
+            Gemv('t', mm, kk, 1.0, Vt_.memptr(), Vt_.mem_n_rows(), tmp, 1.0, YT); // Y += tmp*Vt
+        }
+        StoreResult(YT, Y);
+    }
+
+    // Same arguments as BlockRankOneUpgrade, mkQ = N*Q must have been computed with MatrixVectorMult above.
+    // The new N is [[N, 0], [0, 0]] + [mkQ; -1] * STilde * [R*N, -1].
+    void Upgrade(Matrix<T> &B, const SiteVector_t &mkQ, const SiteVector_t &R, const double &STilde)
+    {
+        const size_t kk = B.n_rows();
+        const size_t kkp1 = kk + 1;
+
+        SiteVector_t Rmk = vec1_.View(kk);
+        if (static_cast<bool>(kk))
+        {
+            VectorMatrixMult(R, B, Rmk);
+        }
+
+        B.Resize(kkp1, kkp1);
+        for (size_t ii = 0; ii < kkp1; ii++)
+        {
+            B(ii, kk) = 0.0;
+            B(kk, ii) = 0.0;
+        }
+
+        Grow(kkp1);
+        for (size_t ii = 0; ii < kk; ii++)
+        {
+            U_(ii, nPending_ - 1) = mkQ(ii);
+            Vt_(nPending_ - 1, ii) = STilde * Rmk(ii);
+        }
+        U_(kk, nPending_ - 1) = -1.0;
+        Vt_(nPending_ - 1, kk) = -STilde;
+    }
+
+    // Same as BlockRankOneDowngrade: the row and col pp are removed and the last row and col are now at index pp.
+    void Downgrade(Matrix<T> &B, const size_t &pp)
+    {
+        const size_t kk = B.n_rows();
+        const size_t kkm1 = kk - 1;
+
+        if (kkm1 == 0)
+        {
+            B.Clear();
+            Clear();
+            return;
+        }
+
+        SiteVector_t lastCol = vec1_.View(kk);
+        SiteVector_t lastRow = vec2_.View(kk);
+        for (size_t ii = 0; ii < kk; ii++)
+        {
+            lastCol(ii) = Element(B, ii, pp);
+            lastRow(ii) = Element(B, pp, ii);
+        }
+        const double alpha = -1.0 / lastCol(pp);
+
+        // S = S - A12 A22^(-1) A21, accumulated instead of applied.
+        Grow(kk);
+        for (size_t ii = 0; ii < kk; ii++)
+        {
+            U_(ii, nPending_ - 1) = lastCol(ii);
+            Vt_(nPending_ - 1, ii) = alpha * lastRow(ii);
+        }
+
+        B.SwapRowsAndCols(pp, kkm1);
+        if (pp != kkm1)
+        {
+            for (size_t ll = 0; ll < nPending_; ll++)
+            {
+                std::swap(U_(pp, ll), U_(kkm1, ll));
+                std::swap(Vt_(ll, pp), Vt_(ll, kkm1));
+            }
+        }
+
+        B.Resize(kkm1, kkm1);
+        U_.Resize(kkm1, nPending_);
+        Vt_.Resize(nPending_, kkm1);
+    }
+
+    // Same as RankOneUpdate, N = N + alpha * X * Y^T, the size does not change.
+    void RankOneUpdate(const Matrix<T> &B, const SiteVector_t &X, const SiteVector_t &Y, const double &alpha)
+    {
+        const size_t kk = B.n_rows();
+        Grow(kk);
+        for (size_t ii = 0; ii < kk; ii++)
+        {
+            U_(ii, nPending_ - 1) = X(ii);
+            Vt_(nPending_ - 1, ii) = alpha * Y(ii);
+        }
+    }
+
+    // B = B + U*Vt
+    void Flush(Matrix<T> &B)
+    {
+        if (!static_cast<bool>(nPending_))
+        {
+            return;
+        }
+        if (static_cast<bool>(B.n_rows()))
+        {
+            DGEMM(1.0, 1.0, U_, Vt_, B);
+        }
+        Clear();
+    }
+
+    // Return N without touching the pending updates.
+    Matrix_t Materialize(const Matrix<T> &B) const
+    {
+        Matrix<T> materialized(B);
+        if (static_cast<bool>(nPending_) && static_cast<bool>(B.n_rows()))
+        {
+            DGEMM(1.0, 1.0, U_, Vt_, materialized);
+        }
+        Matrix_t result;
+        result.CopyFrom(materialized);
+        return result;
+    }
+
+    void Clear()
+    {
+        nPending_ = 0;
+        U_.Clear();
+        Vt_.Clear();
+    }
+
+  private:
+    // Add one pending update, the matrix being kk x kk. New rows of U and cols of Vt are zero.
+    void Grow(const size_t &kk)
+    {
+        const size_t kkOld = U_.n_rows();
+        U_.Resize(kk, nPending_ + 1);
+        Vt_.Resize(nPending_ + 1, kk);
+        for (size_t ll = 0; ll < nPending_; ll++)
+        {
+            for (size_t ii = kkOld; ii < kk; ii++)
+            {
+                U_(ii, ll) = 0.0;
+                Vt_(ll, ii) = 0.0;
+            }
+        }
+        nPending_++;
+    }
+
+    size_t maxDelay_;
+    size_t nPending_{0};
+    Matrix<T> U_;  // kk x nPending_
+    Matrix<T> Vt_; // nPending_ x kk
+    ScratchVectorT<T> tmp_;
+    ScratchVectorT<T> xT_;
+    ScratchVectorT<T> yT_;
+    ScratchVector vec1_;
+    ScratchVector vec2_;
+};
+
+using DelayedRankOne = DelayedRankOneT<double>;
+
+} // namespace LinAlg
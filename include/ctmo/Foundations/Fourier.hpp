@@ -19,6 +19,17 @@ double MatToTau(const SiteVectorCD_t &greenMat, const double &tau,
     return (2.0 * greenTau / beta);
 }
 
+// The moments fm / iwn + sm / iwn^2 + tm / iwn^3 in tau, for 0 < tau < beta.
+double TailToTau(const double &tau, const double &beta, const double &fm, const double &sm, const double &tm)
+{
+    return -0.5 * fm + (tau / 2.0 - beta / 4.0) * sm - 1.0 / 4.0 * (tau * (tau - beta)) * tm;
+}
+
+double TailToTauDerivative(const double &tau, const double &beta, const double &sm, const double &tm)
+{
+    return 0.5 * sm - 0.25 * (2.0 * tau - beta) * tm;
+}
+
 double MatToTauAnalytic(SiteVectorCD_t greenMat, const double &tau, const double &beta, const double &fm, const double &sm,
                         const double &tm)
 {
@@ -26,9 +37,7 @@ double MatToTauAnalytic(SiteVectorCD_t greenMat, const double &tau, const double
     double result = 0.0;
 
     // result+= les moments en tau calculés analytiquement
-    result += -0.5 * fm;
-    result += (tau / 2.0 - beta / 4.0) * sm;
-    result += -1.0 / 4.0 * (tau * (tau - beta)) * tm;
+    result += TailToTau(tau, beta, fm, sm, tm);
 
     // On transforme la greenMat moins ses moments
     for (size_t n = 0; n < greenMat.n_elem; n++)
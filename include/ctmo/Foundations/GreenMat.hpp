@@ -137,7 +137,7 @@ class GreenCluster0Mat
         return *this;
     }
 
-    ClusterCubeCD_t data() const { return data_; };
+    const ClusterCubeCD_t &data() const { return data_; };
     ClusterMatrixCD_t zm() const { return zm_; };
     ClusterMatrixCD_t fm() const { return fm_; };
     ClusterMatrixCD_t sm() const { return sm_; };
@@ -2,6 +2,16 @@
 
 #include "ctmo/Foundations/Fourier.hpp"
 #include "ctmo/Foundations/IO.hpp"
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <numeric>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
 
 namespace GreenTau
 {
@@ -10,6 +20,108 @@ using namespace GreenMat;
 using Vector_t = std::vector<double>;
 using Data_t = std::vector<Vector_t>;
 
+// Scratch memory of the batched evaluations of G0 (GreenCluster0Tau::EvaluateRowCol), kept by the caller so that they do not allocate.
+struct BatchScratch
+{
+    void Reserve(const size_t &kk)
+    {
+        if (kk > offsets_.size())
+        {
+            offsets_.resize(static_cast<size_t>(1.20 * (kk + 1)));
+            dts_.resize(offsets_.size());
+        }
+    }
+
+    std::vector<size_t> offsets_;
+    std::vector<double> dts_;
+};
+
+// Linear: g(tau_n) on the grid, interpolated linearly. CubicHermite: g(tau_n) and dg/dtau(tau_n), interpolated by the cubic
+// polynomial that matches both at the two ends of the interval, with an error in dtau^4 instead of dtau^2.
+enum class Interpolation
+{
+    Linear,
+    CubicHermite
+};
+
+// Memory of a G0 table: of this process, a segment shared by the processes of the node (mpiUt::NodeSharedArray), or a cache file
+// mapped read only. The copies share the memory, the table is read only once built.
+template <typename T> class TableStorage
+{
+  public:
+    void Allocate(const size_t &size)
+    {
+        data_.reset(new T[size](), std::default_delete<T[]>());
+        size_ = size;
+    }
+
+#ifdef HAVEMPI
+    void AllocateNodeShared(const size_t &size, const mpi::communicator &nodeComm)
+    {
+        segment_ = std::make_shared<mpiUt::NodeSharedArray<T>>(size, nodeComm);
+        data_ = std::shared_ptr<T>(segment_, segment_->data());
+        size_ = size;
+    }
+
+    void Fence() const
+    {
+        if (segment_)
+        {
+            segment_->Fence();
+        }
+    }
+#endif
+
+    // The size elements at offset bytes in the file fname, mapped read only (the processes of a node share the pages). Returns false
+    // if the file is too short or cannot be mapped.
+    bool Map(const std::string &fname, const size_t &offset, const size_t &size)
+    {
+        const int fd = open(fname.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+        struct stat fileStat;
+        const size_t bytes = offset + size * sizeof(T);
+        if ((fstat(fd, &fileStat) != 0) || (static_cast<size_t>(fileStat.st_size) < bytes))
+        {
+            close(fd);
+            return false;
+        }
+        void *const addr = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED)
+        {
+            return false;
+        }
+
+        const std::shared_ptr<void> mapping(addr, [bytes](void *pp) { munmap(pp, bytes); });
+        data_ = std::shared_ptr<T>(mapping, reinterpret_cast<T *>(static_cast<char *>(addr) + offset));
+        size_ = size;
+        return true;
+    }
+
+    void Clear()
+    {
+        data_.reset();
+#ifdef HAVEMPI
+        segment_.reset();
+#endif
+        size_ = 0;
+    }
+
+    size_t size() const { return size_; }
+    const T *data() const { return data_.get(); }
+    T *data() { return data_.get(); }
+
+  private:
+    std::shared_ptr<T> data_;
+#ifdef HAVEMPI
+    std::shared_ptr<mpiUt::NodeSharedArray<T>> segment_;
+#endif
+    size_t size_{0};
+};
+
 class GreenCluster0Tau
 {
     // definit par la fct hyb, tloc, mu et beta et un Nombre de slice de temps NTau
@@ -17,26 +129,90 @@ class GreenCluster0Tau
   public:
     const double EPS = 1e-13;
     const double deltaTau = 0.008;
+    const double deltaTauCubic = 0.08; // about the accuracy of deltaTau with the linear interpolation
+
+    // solver.g0Interpolation: "linear" (default) or "cubic".
+    static Interpolation InterpolationOf(const Json &jjSolver)
+    {
+        const std::string interpolation = jjSolver.value("g0Interpolation", std::string("linear"));
+        if (interpolation == "linear")
+        {
+            return Interpolation::Linear;
+        }
+        if (interpolation == "cubic")
+        {
+            return Interpolation::CubicHermite;
+        }
+        throw std::runtime_error("solver.g0Interpolation should be linear or cubic, not " + interpolation + ".");
+    }
 
-    GreenCluster0Tau(const GreenCluster0Mat &gfMatCluster, const std::shared_ptr<IO::Base_IOModel> &ioModelPtr, const size_t &NTau)
-        : ioModelPtr_(ioModelPtr), gfMatCluster_(gfMatCluster), beta_(gfMatCluster.beta()), NTau_(std::max<double>(NTau, beta_ / deltaTau)),
-          NOrb_(gfMatCluster_.n_rows() / ioModelPtr_->Nc)
+    // The processes with the same replicaIndex (the same U of the replica exchange, see mpiUt::ReplicaLadder) build the table together.
+    // With isSinglePrecision, the table is built in double and then stored in float; the interpolations still compute in double.
+    // Each process builds its pairs in nThreads threads. With isNodeShared (and mpi), the processes of a node build one table in a
+    // segment of the node, without gathering it on every process. With a cacheDir, the table is saved there, and mapped from there
+    // instead of built when G0(iwn), NTau and the pairs of the model are the same as the ones of a previous run (see CacheKey).
+    GreenCluster0Tau(const GreenCluster0Mat &gfMatCluster, const std::shared_ptr<IO::Base_IOModel> &ioModelPtr, const size_t &NTau,
+                     const size_t &replicaIndex = 0, const Interpolation &interpolation = Interpolation::Linear,
+                     const bool &isSinglePrecision = false, const size_t &nThreads = 1, const bool &isNodeShared = false,
+                     const std::string &cacheDir = "")
+        : ioModelPtr_(ioModelPtr), gfMatCluster_(gfMatCluster), beta_(gfMatCluster.beta()),
+          NTau_(std::max<double>(NTau, beta_ / ((interpolation == Interpolation::CubicHermite) ? deltaTauCubic : deltaTau))),
+          NOrb_(gfMatCluster_.n_rows() / ioModelPtr_->Nc), Nc_(ioModelPtr_->Nc), nSuperSites_(Nc_ * NOrb_), interpolation_(interpolation),
+          stride_((interpolation == Interpolation::CubicHermite) ? 2 : 1), isSinglePrecision_(isSinglePrecision)
     {
         Logging::Debug("Creating gtau ");
         assert(NOrb_ >= 1);
-        data_.resize(ioModelPtr_->GetNIndepSuperSites(NOrb_));
+        const size_t tableSize = ioModelPtr_->GetNIndepSuperSites(NOrb_) * stride_ * (NTau_ + 1);
+        const std::string cacheFile = cacheDir.empty() ? std::string() : CacheFileName(cacheDir);
 
+        // The processes of a replica all map the cache, or all build the table.
+        bool isCached = !cacheFile.empty() && LoadCache(cacheFile, tableSize);
 #ifdef HAVEMPI
         mpi::communicator world;
-        BuildParallel();
+        const mpi::communicator replicaComm = world.split(static_cast<int>(replicaIndex));
+        isCached = mpi::all_reduce(replicaComm, isCached, std::logical_and<bool>());
+        const bool isCacheWriter = (replicaComm.rank() == 0);
 #else
-        BuildSerial();
+        const bool isCacheWriter = true;
 #endif
 
-        if (mpiUt::Tools::Rank() == mpiUt::Tools::master)
+        if (isCached)
         {
-            Save("gtau.dat");
+            Logging::Info("G0(tau) table mapped from " + cacheFile + ".");
+        }
+        else
+        {
+#ifdef HAVEMPI
+            if (isNodeShared)
+            {
+                const mpi::communicator nodeComm = mpiUt::SplitNode(replicaComm);
+                AllocateTable(tableSize, nodeComm);
+                BuildNode(nodeComm, nThreads);
+            }
+            else
+            {
+                AllocateTable(tableSize);
+                BuildParallel(replicaComm, nThreads);
+            }
+#else
+            if (isNodeShared)
+            {
+                Logging::Warn("The node shared G0 table needs mpi, the table is in the process.");
+            }
+            AllocateTable(tableSize);
+            BuildSerial(nThreads);
+#endif
+            if (!cacheFile.empty() && isCacheWriter)
+            {
+                SaveCache(cacheFile);
+            }
+
+            if (mpiUt::Tools::Rank() == mpiUt::Tools::master)
+            {
+                Save("gtau.dat");
+            }
         }
+        BuildPairOffsets();
 
         gfMatCluster_.clear();
         Logging::Debug("gtau Created");
@@ -44,16 +220,46 @@ class GreenCluster0Tau
 
     GreenCluster0Tau(const GreenCluster0Tau &gf) = default;
 
-    Vector_t BuildOneGTau(const size_t &indepSuperSiteIndex) // return g_i(tau)
+    // g_i(tau_n), followed by dtau * dg_i/dtau(tau_n) for each n with the cubic interpolation. The moments are done analytically, the
+    // rest with one FFT of length NTau: with wn = (2m + 1) pi / beta and tau_n = n beta / NTau,
+    //   sum_m Re[G(iwm) e^(-iwm tau_n)] = Re[e^(-i pi n / NTau) sum_m G(iwm) e^(-2 pi i m n / NTau)],
+    // so the frequencies are folded modulo NTau first. The derivative is the same transform of -iwm G(iwm).
+    Vector_t BuildOneGTau(const size_t &indepSuperSiteIndex) const
     {
-        Vector_t result(NTau_ + 1);
         const std::pair<size_t, size_t> indices = ioModelPtr_->GetIndices(indepSuperSiteIndex, NOrb_);
         const size_t s1 = indices.first;
         const size_t s2 = indices.second;
+        const ClusterCubeCD_t &greenMat = gfMatCluster_.data();
+        const double fm = gfMatCluster_.fm()(s1, s2).real();
+        const double sm = gfMatCluster_.sm()(s1, s2).real();
+        const double tm = gfMatCluster_.tm()(s1, s2).real();
+        const bool isCubic = (interpolation_ == Interpolation::CubicHermite);
+
+        arma::cx_vec folded(NTau_, arma::fill::zeros);
+        arma::cx_vec foldedDerivative(isCubic ? NTau_ : 0, arma::fill::zeros);
+        for (size_t nn = 0; nn < greenMat.n_slices; nn++)
+        {
+            const cd_t iwn(0.0, (2.0 * nn + 1.0) * M_PI / beta_);
+            const cd_t gg = greenMat(s1, s2, nn) - (fm / iwn + sm / (iwn * iwn) + tm / (iwn * iwn * iwn));
+            folded(nn % NTau_) += gg;
+            if (isCubic)
+            {
+                foldedDerivative(nn % NTau_) -= iwn * gg;
+            }
+        }
+
+        const arma::cx_vec transformed = arma::fft(folded);
+        arma::cx_vec transformedDerivative;
+        if (isCubic)
+        {
+            transformedDerivative = arma::fft(foldedDerivative);
+        }
 
+        Vector_t result(stride_ * (NTau_ + 1));
+        const double dtau = beta_ / static_cast<double>(NTau_);
         for (size_t tt = 0; tt < NTau_ + 1; tt++)
         {
-            Tau_t tau = gfMatCluster_.beta() * (static_cast<double>(tt)) / static_cast<double>(NTau_);
+            Tau_t tau = beta_ * (static_cast<double>(tt)) / static_cast<double>(NTau_);
             if (tt == 0)
             {
                 tau += EPS;
@@ -63,43 +269,106 @@ class GreenCluster0Tau
                 tau -= EPS;
             }
 
-            const SiteVectorCD_t greenMat = gfMatCluster_.data().tube(s1, s2);
-            const double fm = gfMatCluster_.fm()(s1, s2).real();
-            const double sm = gfMatCluster_.sm()(s1, s2).real();
-            const double tm = gfMatCluster_.tm()(s1, s2).real();
-            result.at(tt) = Fourier::MatToTauAnalytic(greenMat, tau, beta_, fm, sm, tm);
+            const cd_t phase = std::polar(1.0, -M_PI * static_cast<double>(tt) / static_cast<double>(NTau_));
+            result.at(stride_ * tt) = Fourier::TailToTau(tau, beta_, fm, sm, tm) + 2.0 / beta_ * (phase * transformed(tt % NTau_)).real();
+            if (isCubic)
+            {
+                result.at(stride_ * tt + 1) = dtau * (Fourier::TailToTauDerivative(tau, beta_, sm, tm) +
+                                                      2.0 / beta_ * (phase * transformedDerivative(tt % NTau_)).real());
+            }
         }
 
         return result;
     }
 
-    void BuildSerial()
+    // The g_i(tau) of the independent pairs indepSuperSiteIndices, spread over nThreads threads (they only read gfMatCluster_).
+    Data_t BuildThreads(const std::vector<size_t> &indepSuperSiteIndices, const size_t &nThreads) const
+    {
+        Data_t result(indepSuperSiteIndices.size());
+        const size_t nWorkers = std::max<size_t>(1, std::min(nThreads, indepSuperSiteIndices.size()));
+        std::vector<std::thread> threads;
+        std::vector<std::exception_ptr> exceptions(nWorkers);
+        for (size_t ii = 0; ii < nWorkers; ii++)
+        {
+            threads.emplace_back([this, &indepSuperSiteIndices, &result, &exceptions, nWorkers, ii]() {
+                try
+                {
+                    for (size_t jj = ii; jj < indepSuperSiteIndices.size(); jj += nWorkers)
+                    {
+                        result.at(jj) = BuildOneGTau(indepSuperSiteIndices.at(jj));
+                    }
+                }
+                catch (...)
+                {
+                    exceptions.at(ii) = std::current_exception();
+                }
+            });
+        }
+
+        for (auto &thread : threads)
+        {
+            thread.join();
+        }
+
+        for (const auto &exception : exceptions)
+        {
+            if (exception)
+            {
+                std::rethrow_exception(exception);
+            }
+        }
+        return result;
+    }
+
+    // Copies g_i(tau) (see BuildOneGTau) in the table, in float with isSinglePrecision.
+    void StoreGTau(const size_t &indepSuperSiteIndex, const Vector_t &g0Tau)
     {
-        for (size_t i = 0; i < ioModelPtr_->GetNIndepSuperSites(NOrb_); i++)
+        const size_t tableSize = stride_ * (NTau_ + 1);
+        assert(g0Tau.size() == tableSize);
+        assert((indepSuperSiteIndex + 1) * tableSize <= TableSize());
+        if (isSinglePrecision_)
         {
-            data_.at(i) = BuildOneGTau(i);
+            std::copy(g0Tau.begin(), g0Tau.end(), tableSingle_.data() + indepSuperSiteIndex * tableSize);
+        }
+        else
+        {
+            std::copy(g0Tau.begin(), g0Tau.end(), table_.data() + indepSuperSiteIndex * tableSize);
+        }
+    }
+
+    void BuildSerial(const size_t &nThreads)
+    {
+        std::vector<size_t> indepSuperSiteIndices(ioModelPtr_->GetNIndepSuperSites(NOrb_));
+        std::iota(indepSuperSiteIndices.begin(), indepSuperSiteIndices.end(), 0);
+        const Data_t data = BuildThreads(indepSuperSiteIndices, nThreads);
+        for (size_t ll = 0; ll < data.size(); ll++)
+        {
+            StoreGTau(ll, data.at(ll));
         }
     }
 
 #ifdef HAVEMPI
-    void BuildParallel()
+    // The processes of comm build every comm.size()-th pair, each with its threads, then gather them one round at a time.
+    void BuildParallel(const mpi::communicator &comm, const size_t &nThreads)
     {
-        mpi::communicator world;
+        const auto nWorkers = static_cast<size_t>(comm.size());
+        const auto rank = static_cast<size_t>(comm.rank());
+
+        std::vector<size_t> indepSuperSiteIndices;
+        for (size_t ll = rank; ll < ioModelPtr_->GetNIndepSuperSites(NOrb_); ll += nWorkers)
+        {
+            indepSuperSiteIndices.push_back(ll);
+        }
+        const Data_t dataRank = BuildThreads(indepSuperSiteIndices, nThreads);
 
         std::vector<Data_t> dataVec;
         size_t ii = 0;
-        while (ii * mpiUt::Tools::NWorkers() < ioModelPtr_->GetNIndepSuperSites(NOrb_))
+        while (ii * nWorkers < ioModelPtr_->GetNIndepSuperSites(NOrb_))
         {
-            const size_t indepSuperSiteIndex = mpiUt::Tools::Rank() + ii * mpiUt::Tools::NWorkers();
-            Vector_t g0Tau;
-
-            if (indepSuperSiteIndex < ioModelPtr_->GetNIndepSuperSites(NOrb_))
-            {
-                g0Tau = BuildOneGTau(indepSuperSiteIndex);
-            }
+            const Vector_t g0Tau = (ii < dataRank.size()) ? dataRank.at(ii) : Vector_t();
 
             Data_t dataResult;
-            mpi::all_gather(world, g0Tau, dataResult);
+            mpi::all_gather(comm, g0Tau, dataResult);
             dataVec.push_back(dataResult);
             ii++;
         }
@@ -111,13 +380,56 @@ class GreenCluster0Tau
 
             for (size_t kk = 0; kk < dataVec.at(ll).size() && jj < ioModelPtr_->GetNIndepSuperSites(NOrb_); kk++)
             {
-                data_.at(jj) = dataVec.at(ll).at(kk);
+                StoreGTau(jj, dataVec.at(ll).at(kk));
                 jj++;
             }
         }
     }
+
+    // The processes of nodeComm build every nodeComm.size()-th pair, each with its threads, and write it in the table of the node.
+    void BuildNode(const mpi::communicator &nodeComm, const size_t &nThreads)
+    {
+        std::vector<size_t> indepSuperSiteIndices;
+        for (size_t ll = static_cast<size_t>(nodeComm.rank()); ll < ioModelPtr_->GetNIndepSuperSites(NOrb_);
+             ll += static_cast<size_t>(nodeComm.size()))
+        {
+            indepSuperSiteIndices.push_back(ll);
+        }
+        const Data_t dataRank = BuildThreads(indepSuperSiteIndices, nThreads);
+
+        table_.Fence();
+        tableSingle_.Fence();
+        for (size_t ii = 0; ii < dataRank.size(); ii++)
+        {
+            StoreGTau(indepSuperSiteIndices.at(ii), dataRank.at(ii));
+        }
+        table_.Fence();
+        tableSingle_.Fence();
+    }
 #endif
 
+    // The g_i(tau) are one after the other in table_ (or tableSingle_). The offset in the table of each pair of super sites, so that
+    // an evaluation does not go through FindIndepSuperSiteIndex.
+    void BuildPairOffsets()
+    {
+        const size_t tableSize = stride_ * (NTau_ + 1);
+        pairOffsets_.resize(nSuperSites_ * nSuperSites_);
+        for (size_t o1 = 0; o1 < NOrb_; o1++)
+        {
+            for (size_t s1 = 0; s1 < Nc_; s1++)
+            {
+                for (size_t o2 = 0; o2 < NOrb_; o2++)
+                {
+                    for (size_t s2 = 0; s2 < Nc_; s2++)
+                    {
+                        const size_t ll = ioModelPtr_->FindIndepSuperSiteIndex({s1, o1}, {s2, o2}, NOrb_);
+                        pairOffsets_.at(SuperSiteIndex({s1, o1}) * nSuperSites_ + SuperSiteIndex({s2, o2})) = ll * tableSize;
+                    }
+                }
+            }
+        }
+    }
+
     ~GreenCluster0Tau() = default;
 
     GreenCluster0Mat gfMatCluster() const { return gfMatCluster_; };
@@ -125,28 +437,63 @@ class GreenCluster0Tau
 
     void Clear()
     {
-        data_.clear();
+        table_.Clear();
+        tableSingle_.Clear();
         gfMatCluster_.clear();
     }
 
-    double operator()(const SuperSite_t &s1, const SuperSite_t &s2, const Tau_t &tauIn)
+    double operator()(const SuperSite_t &s1, const SuperSite_t &s2, const Tau_t &tauIn) const
     {
-        assert(NOrb_ >= 1);
-        double tau = tauIn - EPS;
+        const size_t offset = PairOffset(SuperSiteIndex(s1), SuperSiteIndex(s2));
+        return isSinglePrecision_ ? Interpolate(tableSingle_, offset, tauIn) : Interpolate(table_, offset, tauIn);
+    }
 
-        double aps = 1.0;
+    // G0 between the part (s, tau) and the kk parts (anything with the columns superSites() and taus(), like
+    // Diagrammatic::VertexPartStore), in one call: row[j] = G0(s, s_j, tau - tau_j) and col[j] = G0(s_j, s, tau_j - tau), row or col
+    // can be nullptr. The table offsets and the times are gathered first, then the interpolation runs on contiguous arrays.
+    template <typename TParts_t>
+    void EvaluateRowCol(const SuperSite_t &s, const Tau_t &tau, const TParts_t &parts, const size_t &kk, BatchScratch &scratch, double *row,
+                        double *col) const
+    {
+        scratch.Reserve(kk);
+        size_t *const offsets = scratch.offsets_.data();
+        double *const dts = scratch.dts_.data();
+        const size_t index = SuperSiteIndex(s);
+        const SuperSite_t *const superSites = parts.superSites().data();
+        const Tau_t *const taus = parts.taus().data();
+
+        if (row != nullptr)
+        {
+            for (size_t jj = 0; jj < kk; jj++)
+            {
+                offsets[jj] = PairOffset(index, SuperSiteIndex(superSites[jj]));
+                dts[jj] = tau - taus[jj];
+            }
+            Interpolate(kk, offsets, dts, row);
+        }
 
-        if (tau < 0.0)
+        if (col != nullptr)
         {
-            tau += beta_;
-            aps = -1.0;
+            for (size_t jj = 0; jj < kk; jj++)
+            {
+                offsets[jj] = PairOffset(SuperSiteIndex(superSites[jj]), index);
+                dts[jj] = taus[jj] - tau;
+            }
+            Interpolate(kk, offsets, dts, col);
         }
+    }
 
-        const size_t ll = ioModelPtr_->FindIndepSuperSiteIndex(s1, s2, NOrb_);
-        const double nt = std::abs(tau) / beta_ * static_cast<double>(NTau_);
-        const size_t n0 = static_cast<size_t>(nt);
-        const double greentau0 = aps * ((1.0 - (nt - n0)) * data_.at(ll).at(n0) + (nt - n0) * data_[ll].at(n0 + 1));
-        return greentau0;
+    // Interpolation of the kk values out[j] = g(dts[j]) in the table at offsets[j], antiperiodic in tau.
+    void Interpolate(const size_t &kk, const size_t *offsets, const double *dts, double *out) const
+    {
+        if (isSinglePrecision_)
+        {
+            Interpolate(tableSingle_, kk, offsets, dts, out);
+        }
+        else
+        {
+            Interpolate(table_, kk, offsets, dts, out);
+        }
     }
 
     GreenCluster0Tau &operator=(const GreenCluster0Tau &gf)
@@ -158,7 +505,14 @@ class GreenCluster0Tau
         NTau_ = gf.NTau_;
         beta_ = gf.beta_;
         NOrb_ = gf.NOrb_;
-        data_ = gf.data_;
+        Nc_ = gf.Nc_;
+        nSuperSites_ = gf.nSuperSites_;
+        interpolation_ = gf.interpolation_;
+        stride_ = gf.stride_;
+        isSinglePrecision_ = gf.isSinglePrecision_;
+        table_ = gf.table_;
+        tableSingle_ = gf.tableSingle_;
+        pairOffsets_ = gf.pairOffsets_;
         return *this;
     }
 
@@ -170,9 +524,10 @@ class GreenCluster0Tau
         for (size_t tt = 0; tt < NTau_ + 1; tt++)
         {
             fout << beta_ * double(tt) / (static_cast<double>(NTau_)) << " ";
-            for (size_t ii = 0; ii < data_.size(); ii++)
+            for (size_t ii = 0; ii < TableSize() / (stride_ * (NTau_ + 1)); ii++)
             {
-                fout << data_.at(ii).at(tt) << " ";
+                const size_t index = stride_ * (ii * (NTau_ + 1) + tt);
+                fout << (isSinglePrecision_ ? tableSingle_.data()[index] : table_.data()[index]) << " ";
             }
             fout << "\n";
         }
@@ -180,12 +535,181 @@ class GreenCluster0Tau
     }
 
   private:
+    // Index of the super site (site, orbital) in pairOffsets_.
+    size_t SuperSiteIndex(const SuperSite_t &s) const
+    {
+        assert((s.first < Nc_) && (s.second < NOrb_));
+        return s.first + Nc_ * s.second;
+    }
+
+    size_t PairOffset(const size_t &index1, const size_t &index2) const
+    {
+        assert(index1 * nSuperSites_ + index2 < pairOffsets_.size());
+        return pairOffsets_[index1 * nSuperSites_ + index2];
+    }
+
+    size_t TableSize() const { return isSinglePrecision_ ? tableSingle_.size() : table_.size(); }
+
+    // Everything the table depends on: G0(iwn) (so the hybridization, tLoc, mu and beta), the times and the storage, and the
+    // independent pairs of super sites of the model.
+    UInt64_t CacheKey() const
+    {
+        const ClusterCubeCD_t &greenMat = gfMatCluster_.data();
+        UInt64_t key = Utilities::HashBytes(&CACHE_VERSION, sizeof(CACHE_VERSION));
+        key = Utilities::HashBytes(greenMat.memptr(), greenMat.n_elem * sizeof(cd_t), key);
+        for (const ClusterMatrixCD_t &moment : {gfMatCluster_.fm(), gfMatCluster_.sm(), gfMatCluster_.tm()})
+        {
+            key = Utilities::HashBytes(moment.memptr(), moment.n_elem * sizeof(cd_t), key);
+        }
+
+        std::vector<size_t> layout = {NTau_, stride_, isSinglePrecision_ ? sizeof(float) : sizeof(double), Nc_, NOrb_};
+        for (size_t ll = 0; ll < ioModelPtr_->GetNIndepSuperSites(NOrb_); ll++)
+        {
+            const std::pair<size_t, size_t> indices = ioModelPtr_->GetIndices(ll, NOrb_);
+            layout.insert(layout.end(), {indices.first, indices.second});
+        }
+        key = Utilities::HashBytes(&beta_, sizeof(beta_), key);
+        return Utilities::HashBytes(layout.data(), layout.size() * sizeof(size_t), key);
+    }
+
+    std::string CacheFileName(const std::string &cacheDir) const
+    {
+        std::ostringstream oss;
+        oss << cacheDir << "/gtau_" << std::hex << std::setw(16) << std::setfill('0') << CacheKey() << ".bin";
+        return oss.str();
+    }
+
+    // Cache file: CACHE_HEADER_SIZE bytes of header (CACHE_MAGIC, then as u64 the version, the key, NTau, the stride, the size of the
+    // elements and the number of elements), then the table as in memory. Written under another name, then renamed, so that the
+    // other runs never see a partial file.
+    void SaveCache(const std::string &fname) const
+    {
+        const std::array<std::uint64_t, 6> header = {
+            CACHE_VERSION, CacheKey(), NTau_, stride_, isSinglePrecision_ ? sizeof(float) : sizeof(double), TableSize()};
+        const std::string fnameTmp = fname + "." + std::to_string(getpid()) + ".tmp";
+        boost::system::error_code errorCode;
+        boost::filesystem::create_directories(boost::filesystem::path(fname).parent_path(), errorCode);
+        {
+            std::ofstream fout(fnameTmp, std::ios::binary);
+            std::string head(CACHE_HEADER_SIZE, '\0');
+            std::memcpy(&head[0], CACHE_MAGIC, sizeof(CACHE_MAGIC));
+            std::memcpy(&head[sizeof(CACHE_MAGIC)], header.data(), sizeof(header));
+            fout.write(head.data(), static_cast<std::streamsize>(head.size()));
+            if (isSinglePrecision_)
+            {
+                fout.write(reinterpret_cast<const char *>(tableSingle_.data()), static_cast<std::streamsize>(TableSize() * sizeof(float)));
+            }
+            else
+            {
+                fout.write(reinterpret_cast<const char *>(table_.data()), static_cast<std::streamsize>(TableSize() * sizeof(double)));
+            }
+            if (!fout.good())
+            {
+                Logging::Warn("Could not write the G0(tau) cache " + fnameTmp + ".");
+                fout.close();
+                std::remove(fnameTmp.c_str());
+                return;
+            }
+        }
+        std::rename(fnameTmp.c_str(), fname.c_str());
+    }
+
+    bool LoadCache(const std::string &fname, const size_t &tableSize)
+    {
+        std::ifstream fin(fname, std::ios::binary);
+        std::string head(CACHE_HEADER_SIZE, '\0');
+        if (!fin.read(&head[0], static_cast<std::streamsize>(head.size())) ||
+            (std::memcmp(head.data(), CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0))
+        {
+            return false;
+        }
+        std::array<std::uint64_t, 6> header{};
+        std::memcpy(header.data(), &head[sizeof(CACHE_MAGIC)], sizeof(header));
+        const std::array<std::uint64_t, 6> expected = {
+            CACHE_VERSION, CacheKey(), NTau_, stride_, isSinglePrecision_ ? sizeof(float) : sizeof(double), tableSize};
+        if (header != expected)
+        {
+            return false;
+        }
+        return isSinglePrecision_ ? tableSingle_.Map(fname, CACHE_HEADER_SIZE, tableSize) : table_.Map(fname, CACHE_HEADER_SIZE, tableSize);
+    }
+
+    void AllocateTable(const size_t &size)
+    {
+        if (isSinglePrecision_)
+        {
+            tableSingle_.Allocate(size);
+        }
+        else
+        {
+            table_.Allocate(size);
+        }
+    }
+
+#ifdef HAVEMPI
+    void AllocateTable(const size_t &size, const mpi::communicator &nodeComm)
+    {
+        if (isSinglePrecision_)
+        {
+            tableSingle_.AllocateNodeShared(size, nodeComm);
+        }
+        else
+        {
+            table_.AllocateNodeShared(size, nodeComm);
+        }
+    }
+#endif
+
+    template <typename TTable_t>
+    void Interpolate(const TTable_t &table, const size_t &kk, const size_t *offsets, const double *dts, double *out) const
+    {
+        for (size_t jj = 0; jj < kk; jj++)
+        {
+            out[jj] = Interpolate(table, offsets[jj], dts[jj]);
+        }
+    }
+
+    template <typename TTable_t> double Interpolate(const TTable_t &table, const size_t &offset, const Tau_t &tauIn) const
+    {
+        double tau = tauIn - EPS;
+        const double aps = (tau < 0.0) ? -1.0 : 1.0;
+        tau += (tau < 0.0) ? beta_ : 0.0;
+
+        const double nt = std::abs(tau) / beta_ * static_cast<double>(NTau_);
+        const auto n0 = static_cast<size_t>(nt);
+        const double xx = nt - n0;
+        assert(offset + stride_ * (n0 + 2) - 1 < table.size());
+        const auto *const gg = table.data() + offset + stride_ * n0;
+        if (interpolation_ == Interpolation::Linear)
+        {
+            return aps * ((1.0 - xx) * static_cast<double>(gg[0]) + xx * static_cast<double>(gg[1]));
+        }
+
+        // gg = {g_0, m_0, g_1, m_1}, with the slopes m already multiplied by dtau.
+        const double g0 = gg[0];
+        const double m0 = gg[1];
+        const double m1 = gg[3];
+        const double delta = static_cast<double>(gg[2]) - g0;
+        return aps * (g0 + xx * (m0 + xx * ((3.0 * delta - 2.0 * m0 - m1) + xx * (m0 + m1 - 2.0 * delta))));
+    }
+
+    static constexpr char CACHE_MAGIC[8] = {'C', 'T', 'M', 'O', 'G', 'T', 'A', 'U'};
+    static constexpr std::uint64_t CACHE_VERSION = 1;
+    static constexpr size_t CACHE_HEADER_SIZE = 64; // keeps the table aligned in the mapped file
+
     std::shared_ptr<IO::Base_IOModel> ioModelPtr_;
     GreenCluster0Mat gfMatCluster_;
-    Data_t data_;
+    TableStorage<double> table_;      // g_ll(tau_n) at stride * (ll * (NTau + 1) + n), its slope right after with the cubic interpolation
+    TableStorage<float> tableSingle_; // the same, in place of table_ with isSinglePrecision
+    std::vector<size_t> pairOffsets_;
 
     double beta_;
     size_t NTau_;
     size_t NOrb_;
+    size_t Nc_;
+    size_t nSuperSites_;
+    Interpolation interpolation_;
+    size_t stride_; // values per tau_n in table_
+    bool isSinglePrecision_;
 };
 } // namespace GreenTau
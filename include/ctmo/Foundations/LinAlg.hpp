@@ -10,6 +10,144 @@ namespace LinAlg
 typedef Matrix<double> Matrix_t;
 typedef Matrix<cd_t> MatrixCD_t;
 
+// Memory of a temporary vector of the markov chain steps. The buffer only grows, View(n) returns an arma vector
+// of size n that uses the buffer's memory, so there is no allocation once the biggest size has been seen.
+template <typename T> class ScratchVectorT
+{
+  public:
+    arma::Col<T> View(const size_t &n)
+    {
+        if (n > buffer_.size())
+        {
+            buffer_.resize(static_cast<size_t>(1.20 * (n + 1)));
+        }
+        return arma::Col<T>(buffer_.data(), n, false, true);
+    }
+
+  private:
+    std::vector<T> buffer_;
+};
+
+using ScratchVector = ScratchVectorT<double>;
+
+// Temporaries of the block updates below, kept by each markov chain and reused from one step to the next.
+// T is the precision of the updated matrix (float for the mixed precision N matrices), the *T_ members hold
+// the vectors and matrices given in double, converted to T.
+template <typename T> struct BlockWorkspaceT
+{
+    ScratchVector vec1_;
+    ScratchVector vec2_;
+    ScratchVectorT<T> vecT1_;
+    ScratchVectorT<T> vecT2_;
+    ScratchVectorT<T> vecT3_;
+    Matrix<T> mat1_;
+    Matrix<T> mat2_;
+    Matrix<T> mat3_;
+    Matrix<T> matT1_;
+    Matrix<T> matT2_;
+    Matrix<T> matT3_;
+};
+
+using BlockWorkspace = BlockWorkspaceT<double>;
+
+// Mixed precision: the N matrices can be stored in float while the vectors of the updates are computed in double.
+// AsPrecision gives a double vector or matrix in the precision of the N matrix, the buffer is only used for float.
+const double *AsPrecision(const SiteVector_t &x, ScratchVectorT<double> &) { return x.memptr(); }
+
+const float *AsPrecision(const SiteVector_t &x, ScratchVectorT<float> &buffer)
+{
+    arma::Col<float> xf = buffer.View(x.n_elem);
+    for (size_t ii = 0; ii < x.n_elem; ii++)
+    {
+        xf(ii) = static_cast<float>(x(ii));
+    }
+    return xf.memptr();
+}
+
+const Matrix_t &AsPrecision(const Matrix_t &A, Matrix_t &) { return A; }
+
+const Matrix<float> &AsPrecision(const Matrix_t &A, Matrix<float> &buffer)
+{
+    buffer.CopyFrom(A);
+    return buffer;
+}
+
+// Memory where a result is computed in the precision of the N matrix, then stored in the double vector y by StoreResult.
+double *ResultMemory(SiteVector_t &y, ScratchVectorT<double> &) { return y.memptr(); }
+
+float *ResultMemory(SiteVector_t &y, ScratchVectorT<float> &buffer) { return buffer.View(y.n_elem).memptr(); }
+
+void StoreResult(const double *, SiteVector_t &) {}
+
+void StoreResult(const float *yf, SiteVector_t &y)
+{
+    for (size_t ii = 0; ii < y.n_elem; ii++)
+    {
+        y(ii) = yf[ii];
+    }
+}
+
+// A = A + alpha * x * y^T, A is m x n
+void Ger(const unsigned int &m, const unsigned int &n, const double &alpha, const double *x, const double *y, double *A,
+         const unsigned int &ld_A)
+{
+    const unsigned int inc = 1;
+    dger_(&m, &n, &alpha, x, &inc, y, &inc, A, &ld_A);
+}
+
+void Ger(const unsigned int &m, const unsigned int &n, const double &alpha, const float *x, const float *y, float *A,
+         const unsigned int &ld_A)
+{
+    const unsigned int inc = 1;
+    const float alphaf = static_cast<float>(alpha);
+    sger_(&m, &n, &alphaf, x, &inc, y, &inc, A, &ld_A);
+}
+
+// y = alpha * op(A) * x + beta * y, A is m x n and op(A) = A (trans = 'n') or A^T (trans = 't')
+void Gemv(const char &trans, const unsigned int &m, const unsigned int &n, const double &alpha, const double *A, const unsigned int &ld_A,
+          const double *x, const double &beta, double *y)
+{
+    const unsigned int inc = 1;
+    dgemv_(&trans, &m, &n, &alpha, A, &ld_A, x, &inc, &beta, y, &inc);
+}
+
+void Gemv(const char &trans, const unsigned int &m, const unsigned int &n, const double &alpha, const float *A, const unsigned int &ld_A,
+          const float *x, const double &beta, float *y)
+{
+    const unsigned int inc = 1;
+    const float alphaf = static_cast<float>(alpha);
+    const float betaf = static_cast<float>(beta);
+    sgemv_(&trans, &m, &n, &alphaf, A, &ld_A, x, &inc, &betaf, y, &inc);
+}
+
+// C = alpha * A * B + beta * C, A is m x kk, B is kk x n and C is m x n. A and B can be blocks of the matrix C is a block of, if
+// they do not overlap C.
+void Gemm(const unsigned int &m, const unsigned int &n, const unsigned int &kk, const double &alpha, const double *A,
+          const unsigned int &ld_A, const double *B, const unsigned int &ld_B, const double &beta, double *C, const unsigned int &ld_C)
+{
+    const char no = 'n';
+    dgemm_(&no, &no, &m, &n, &kk, &alpha, A, &ld_A, B, &ld_B, &beta, C, &ld_C);
+}
+
+void Gemm(const unsigned int &m, const unsigned int &n, const unsigned int &kk, const double &alpha, const float *A,
+          const unsigned int &ld_A, const float *B, const unsigned int &ld_B, const double &beta, float *C, const unsigned int &ld_C)
+{
+    const char no = 'n';
+    const float alphaf = static_cast<float>(alpha);
+    const float betaf = static_cast<float>(beta);
+    sgemm_(&no, &no, &m, &n, &kk, &alphaf, A, &ld_A, B, &ld_B, &betaf, C, &ld_C);
+}
+
+void Copy(const unsigned int &n, const double *x, const unsigned int &inc_x, double *y, const unsigned int &inc_y)
+{
+    dcopy_(&n, x, &inc_x, y, &inc_y);
+}
+
+void Copy(const unsigned int &n, const float *x, const unsigned int &inc_x, float *y, const unsigned int &inc_y)
+{
+    scopy_(&n, x, &inc_x, y, &inc_y);
+}
+
 void ExtractRow(const size_t &p, SiteVector_t &vec, const Matrix_t &A)
 {
     const unsigned int k = A.n_cols();
@@ -179,6 +317,40 @@ void DGEMM(const double &alpha, const double &beta, const Matrix_t &A, const Mat
     return;
 }
 
+// Same as above, in single precision
+void DGEMM(const double &alpha, const double &beta, const Matrix<float> &A, const Matrix<float> &B, Matrix<float> &C,
+           const size_t &colNum = 0)
+{
+    assert(A.n_cols() == B.n_rows());
+    assert(C.n_rows() == A.n_rows());
+    assert((C.n_cols() - colNum) == B.n_cols());
+    const unsigned int n_rowsC = A.n_rows();
+    const unsigned int ld_A = A.mem_n_rows();
+    const unsigned int n_colsC = B.n_cols();
+    const unsigned int ld_B = B.mem_n_rows();
+    const unsigned int n_rowsB = B.n_rows();
+    const unsigned int ld_C = C.mem_n_rows();
+    const float alphaf = static_cast<float>(alpha);
+    const float betaf = static_cast<float>(beta);
+
+    char no = 'n';
+
+    const size_t elemNum = ld_C * colNum;
+    sgemm_(&no, &no, &n_rowsC, &n_colsC, &n_rowsB, &alphaf, A.memptr(), &ld_A, B.memptr(), &ld_B, &betaf, &(C.memptr()[elemNum]), &ld_C);
+}
+
+// C = A*B, with A in the precision of the N matrices and B, C in double.
+void MatrixMatrixMult(const Matrix_t &A, const Matrix_t &B, Matrix_t &C, BlockWorkspace &) { DGEMM(1.0, 0.0, A, B, C); }
+
+void MatrixMatrixMult(const Matrix<float> &A, const Matrix_t &B, Matrix_t &C, BlockWorkspaceT<float> &workspace)
+{
+    const Matrix<float> &Bf = AsPrecision(B, workspace.matT1_);
+    Matrix<float> &Cf = workspace.mat1_;
+    Cf.SetSize(C.n_rows(), C.n_cols());
+    DGEMM(1.0, 0.0, A, Bf, Cf);
+    C.CopyFrom(Cf);
+}
+
 Matrix_t DotRank2(const Matrix_t &m1, const Matrix_t &A, const Matrix_t &m2)
 {
     // result = m1*A*m2
@@ -265,82 +437,92 @@ void LUInverse(const double &alpha, Matrix_t &L, Matrix_t &U, const unsigned int
 }
 
 // Upgrade the matrix if the last element of the inverse is known (STilde)
-void BlockRankOneUpgrade(Matrix_t &mk, const SiteVector_t &mkQ, const SiteVector_t &R, const double &STilde)
+template <typename T>
+void BlockRankOneUpgrade(Matrix<T> &mk, const SiteVector_t &mkQ, const SiteVector_t &R, const double &STilde, BlockWorkspaceT<T> &workspace)
 {
     // mkQ = m^{k}*Q, needed to calculate STilde, see Gull CTQMC review
     const unsigned int k = mk.n_cols();
     const unsigned int kp1 = k + 1;
-    const double one = 1.0;
-
-    SiteVector_t Rmk(k);
-    VectorMatrixMult(R, mk, one, Rmk);
-
-    SiteVector_t QTilde = -STilde * mkQ;
-    SiteVector_t RTilde = -STilde * Rmk;
-
-    const unsigned int inc = 1;
     const unsigned int ld_mk = mk.mem_n_rows();
 
-    dger_(&k, &k, &STilde, &(mkQ.memptr()[0]), &inc, &(Rmk.memptr()[0]), &inc, mk.memptr(), &ld_mk);
+    const T *mkQT = AsPrecision(mkQ, workspace.vecT1_);
+    const T *RT = AsPrecision(R, workspace.vecT2_);
+    T *Rmk = workspace.vecT3_.View(k).memptr();
+    Gemv('t', k, k, 1.0, mk.memptr(), ld_mk, RT, 0.0, Rmk); // Rmk = R*mk
 
+    Ger(k, k, STilde, mkQT, Rmk, mk.memptr(), ld_mk);
+
+    // last row = RTilde = -STilde * Rmk, last col = QTilde = -STilde * mkQ
     mk.Resize(kp1, kp1);
-    const unsigned int ld_mk_resized = mk.mem_n_rows();
-    dcopy_(&k, &(RTilde.memptr()[0]), &inc, &(mk.memptr()[k]), &ld_mk_resized);
-    dcopy_(&k, &(QTilde.memptr()[0]), &inc, &(mk.memptr()[ld_mk_resized * k]), &inc);
+    for (size_t ii = 0; ii < k; ii++)
+    {
+        mk(k, ii) = -STilde * Rmk[ii];
+        mk(ii, k) = -STilde * mkQ(ii);
+    }
 
     mk(k, k) = STilde;
     return;
 }
 
-// Upgrade the matrix if the last matrix element of the inverse is known (STilde)
-void BlockRankTwoUpgrade(Matrix_t &mk, const Matrix_t &mkQ, const Matrix_t &R, const Matrix_t &STilde)
+template <typename T> void BlockRankOneUpgrade(Matrix<T> &mk, const SiteVector_t &mkQ, const SiteVector_t &R, const double &STilde)
+{
+    BlockWorkspaceT<T> workspace;
+    BlockRankOneUpgrade(mk, mkQ, R, STilde, workspace);
+}
+
+// Upgrade the matrix if the last matrix element of the inverse is known (STilde). mk is resized first and the blocks are computed
+// in its memory: Rmk = R*mk in the new rows, QTilde = -mkQ*STilde in the new cols, then mk += -QTilde*Rmk in one gemm, and the new
+// rows become RTilde = -STilde*Rmk.
+template <typename T>
+void BlockRankTwoUpgrade(Matrix<T> &mk, const Matrix_t &mkQ, const Matrix_t &R, const Matrix_t &STilde, BlockWorkspaceT<T> &workspace)
 {
     // mkQ is the matrix given by the multiplication of mk and Q
     const unsigned int k = mk.n_cols();
     const unsigned int kp2 = k + 2;
-    const double one = 1.0;
-    const double zero = 0.0;
-
-    Matrix_t Rmk(R.n_rows(), mk.n_cols());
-    Rmk.Zeros();
-
-    DGEMM(one, zero, R, mk, Rmk);
-
-    Matrix_t QTilde(mkQ.n_rows(), STilde.n_cols());
-    Matrix_t RTilde(STilde.n_rows(), Rmk.n_cols());
+    const unsigned int nn = 2;
+    assert(mkQ.n_rows() == k && mkQ.n_cols() == nn && R.n_rows() == nn && R.n_cols() == k);
 
-    DGEMM(-one, zero, mkQ, STilde, QTilde);
-    DGEMM(-one, zero, STilde, Rmk, RTilde);
+    const Matrix<T> &mkQT = AsPrecision(mkQ, workspace.matT1_);
+    const Matrix<T> &RT = AsPrecision(R, workspace.matT2_);
 
-    mk += DotRank2(mkQ, STilde, Rmk);
     mk.Resize(kp2, kp2);
+    const unsigned int ld_mk = mk.mem_n_rows();
+    T *const mem = mk.memptr();
+    T *const newRows = mem + k;
+    T *const newCols = mem + static_cast<size_t>(ld_mk) * k;
 
-    // const char all = 'A';
-
-    // //copy QTIlde in mk
-    // // dlacpy_(&all, &QTilde.n_rows(), &QTilde.n_cols(), QTilde.memptr(), &QTilde.mem_n_rows(), mk.memptr()[k], &mk.mem_n_rows());
+    for (size_t ii = 0; ii < nn; ii++)
+    {
+        for (size_t jj = 0; jj < nn; jj++)
+        {
+            mk(k + ii, k + jj) = STilde(ii, jj);
+        }
+    }
 
-    // //copy RTilde in mk
-    // dcopy_(&k, RTilde.memptr(), &inc, &(mk.memptr()[k]), &ld_mk_resized);
-    // dcopy_(&k, &(QTilde.memptr()[0]), &inc, &(mk.memptr()[ld_mk_resized * k]), &inc);
-    // // dlacpy_(&all, &RTilde.n_rows(), &RTilde.n_cols(), RTilde.memptr(), &RTilde.mem_n_rows(), mk.memptr()[start], &mk.mem_n_cols());
-    for (size_t ii = 0; ii < k; ii++)
+    if (k != 0)
     {
-        mk(ii, k) = QTilde(ii, 0);
-        mk(ii, k + 1) = QTilde(ii, 1);
+        Gemm(nn, k, k, 1.0, RT.memptr(), RT.mem_n_rows(), mem, ld_mk, 0.0, newRows, ld_mk);                // Rmk
+        Gemm(k, nn, nn, -1.0, mkQT.memptr(), mkQT.mem_n_rows(), newCols + k, ld_mk, 0.0, newCols, ld_mk); // QTilde
+        Gemm(k, k, nn, -1.0, newCols, ld_mk, newRows, ld_mk, 1.0, mem, ld_mk);                              // mk += mkQ*STilde*Rmk
+    }
 
-        mk(k, ii) = RTilde(0, ii);
-        mk(k + 1, ii) = RTilde(1, ii);
+    for (size_t jj = 0; jj < k; jj++)
+    {
+        const double rmk0 = mk(k, jj);
+        const double rmk1 = mk(k + 1, jj);
+        mk(k, jj) = -(STilde(0, 0) * rmk0 + STilde(0, 1) * rmk1);
+        mk(k + 1, jj) = -(STilde(1, 0) * rmk0 + STilde(1, 1) * rmk1);
     }
+}
 
-    mk(k, k) = STilde(0, 0);
-    mk(k, k + 1) = STilde(0, 1);
-    mk(k + 1, k) = STilde(1, 0);
-    mk(k + 1, k + 1) = STilde(1, 1);
+template <typename T> void BlockRankTwoUpgrade(Matrix<T> &mk, const Matrix_t &mkQ, const Matrix_t &R, const Matrix_t &STilde)
+{
+    BlockWorkspaceT<T> workspace;
+    BlockRankTwoUpgrade(mk, mkQ, R, STilde, workspace);
 }
 
 // pp row and col to remove
-void BlockRankOneDowngrade(Matrix_t &m1, const size_t &pp)
+template <typename T> void BlockRankOneDowngrade(Matrix<T> &m1, const size_t &pp, BlockWorkspaceT<T> &workspace)
 {
 
     const unsigned int inc = 1;
@@ -356,17 +538,46 @@ void BlockRankOneDowngrade(Matrix_t &m1, const size_t &pp)
     {
         m1.SwapRows(pp, kkm1);
         m1.SwapCols(pp, kkm1);
-        SiteVector_t lastRow;
-        SiteVector_t lastCol;
-        ExtractRow(kkm1, lastRow, m1);
-        ExtractCol(kkm1, lastCol, m1);
+        T *lastRow = workspace.vecT1_.View(kk).memptr();
+        T *lastCol = workspace.vecT2_.View(kk).memptr();
+        Copy(kk, &(m1.memptr()[kkm1]), ld_m1, lastRow, inc);
+        Copy(kk, &(m1.memptr()[kkm1 * ld_m1]), inc, lastCol, inc);
         const double alpha = -1.0 / m1(kkm1, kkm1);
         // this next line does S = S - A12 A22^(-1) A21;
-        dger_(&kkm1, &kkm1, &alpha, lastCol.memptr(), &inc, lastRow.memptr(), &inc, m1.memptr(), &ld_m1);
+        Ger(kkm1, kkm1, alpha, lastCol, lastRow, m1.memptr(), ld_m1);
         m1.Resize(kkm1, kkm1);
     }
 }
 
+template <typename T> void BlockRankOneDowngrade(Matrix<T> &m1, const size_t &pp)
+{
+    BlockWorkspaceT<T> workspace;
+    BlockRankOneDowngrade(m1, pp, workspace);
+}
+
+// m1 = m1 + alpha * X * Y^T
+void RankOneUpdate(Matrix_t &m1, const SiteVector_t &X, const SiteVector_t &Y, const double &alpha)
+{
+    const unsigned int inc = 1;
+    const unsigned int kk = m1.n_rows();
+    const unsigned int ld_m1 = m1.mem_n_rows();
+    assert(X.n_elem == kk);
+    assert(Y.n_elem == m1.n_cols());
+
+    dger_(&kk, &kk, &alpha, X.memptr(), &inc, Y.memptr(), &inc, m1.memptr(), &ld_m1);
+}
+
+// Same as above, m1 being in the precision T
+template <typename T>
+void RankOneUpdate(Matrix<T> &m1, const SiteVector_t &X, const SiteVector_t &Y, const double &alpha, BlockWorkspaceT<T> &workspace)
+{
+    const unsigned int kk = m1.n_rows();
+    assert(X.n_elem == kk);
+    assert(Y.n_elem == m1.n_cols());
+
+    Ger(kk, kk, alpha, AsPrecision(X, workspace.vecT1_), AsPrecision(Y, workspace.vecT2_), m1.memptr(), m1.mem_n_rows());
+}
+
 // pp row and col to remove
 void BlockDowngrade(Matrix_t &m1, const size_t &pp, const size_t &nn)
 {
@@ -412,45 +623,50 @@ void BlockDowngrade(Matrix_t &m1, const size_t &pp, const size_t &nn)
     }
 }
 
-void BlockRankTwoDowngrade(Matrix_t &m1)
+// Inverse of a 2x2 matrix, without the allocations of Matrix::Inverse
+template <typename T> void Inverse2x2(Matrix<T> &A)
 {
+    assert(A.n_rows() == 2 && A.n_cols() == 2);
+    const T det = A(0, 0) * A(1, 1) - A(0, 1) * A(1, 0);
+    const T a00 = A(0, 0);
+    A(0, 0) = A(1, 1) / det;
+    A(1, 1) = a00 / det;
+    A(0, 1) = -A(0, 1) / det;
+    A(1, 0) = -A(1, 0) / det;
+}
 
-    // pp = row and col number to start remove, is supposed here that it is the last two rows and columns.
-    // nn = number of rows and col to remove = 2
-    // const unsigned int inc = 1;
+// Removes the last two rows and cols, in place: the rows C become D^(-1) C, then m1 = m1 - B D^(-1) C in one gemm on the blocks of m1,
+// with B the last two cols and D the lower-right block.
+template <typename T> void BlockRankTwoDowngrade(Matrix<T> &m1)
+{
     const unsigned int nn = 2;
     const unsigned int kk = m1.n_rows();
     assert(kk >= nn);
     const unsigned int kkmnn = kk - nn;
-    // const unsigned int ld_m1 = m1.mem_n_rows();
 
     if (kkmnn == 0)
     {
         m1.Clear();
+        return;
     }
-    else
-    {
-
-        Matrix_t B; // right-upper block of m1, size = kkmnn x nn
-        Matrix_t C; // left-lower block of m1, size = nn x kkmnn
-        Matrix_t D; // lower-right block of m1, size = nn x nn
-        B = GetSubMat(0, kkmnn, kkmnn, kk, m1);
-        C = GetSubMat(kkmnn, 0, kk, kkmnn, m1);
-        D = GetSubMat(kkmnn, kkmnn, kk, kk, m1);
 
-        // std::cout << "B.n_rows = " << B.n_rows() << std::endl;
-        D.Inverse();
-        // std::cout << " D.n_rows() = " << D.n_rows() << std::endl;
-        // std::cout << " kkmnn = " << kkmnn << std::endl;
-
-        Matrix_t DInverseC(nn, kkmnn);
-        DInverseC.Zeros();
-
-        DGEMM(1.0, 0.0, D, C, DInverseC);
-
-        m1.Resize(kkmnn, kkmnn);
-        DGEMM(-1.0, 1.0, B, DInverseC, m1);
+    const double d00 = m1(kkmnn, kkmnn);
+    const double d01 = m1(kkmnn, kkmnn + 1);
+    const double d10 = m1(kkmnn + 1, kkmnn);
+    const double d11 = m1(kkmnn + 1, kkmnn + 1);
+    const double det = d00 * d11 - d01 * d10;
+    for (size_t jj = 0; jj < kkmnn; jj++)
+    {
+        const double c0 = m1(kkmnn, jj);
+        const double c1 = m1(kkmnn + 1, jj);
+        m1(kkmnn, jj) = (d11 * c0 - d01 * c1) / det;
+        m1(kkmnn + 1, jj) = (d00 * c1 - d10 * c0) / det;
     }
+
+    const unsigned int ld_m1 = m1.mem_n_rows();
+    T *const mem = m1.memptr();
+    Gemm(kkmnn, kkmnn, nn, -1.0, mem + static_cast<size_t>(ld_m1) * kkmnn, ld_m1, mem + kkmnn, ld_m1, 1.0, mem, ld_m1);
+    m1.Resize(kkmnn, kkmnn);
 }
 
 // double-diagonal matrix-general matrix multiplication
@@ -488,4 +704,11 @@ void DDMGMM(const SiteVector_t &diag, Matrix_t &A)
     }
 }
 
+// B = diag*A, A being the single precision N matrix
+void DDMGMM(const SiteVector_t &diag, const Matrix<float> &A, Matrix_t &B)
+{
+    B.CopyFrom(A);
+    DDMGMM(diag, B);
+}
+
 } // namespace LinAlg
\ No newline at end of file
@@ -1,9 +1,14 @@
 #pragma once
 
 #include "ctmo/Foundations/Utilities.hpp"
+#include <algorithm>
 
 #ifdef HAVEMPI
 #include <boost/mpi.hpp>
+#include <boost/serialization/map.hpp>
+#include <boost/serialization/string.hpp>
+#include <boost/serialization/valarray.hpp>
+#include <boost/serialization/vector.hpp>
 namespace mpi = boost::mpi;
 #endif
 
@@ -76,8 +81,8 @@ class Tools
         for (const std::string key : keys)
         {
 
-            updStatsResult[key][0] = double(updStatsResult[key][0]) / double(NWorkers());
-            updStatsResult[key][1] = double(updStatsResult[key][1]) / double(NWorkers());
+            updStatsResult[key][0] = double(updStatsResult[key][0]) / double(updStatsVec.size());
+            updStatsResult[key][1] = double(updStatsResult[key][1]) / double(updStatsVec.size());
             size_t nbProposed = updStatsResult[key][0];
             size_t nbAccepted = updStatsResult[key][1];
 
@@ -87,6 +92,32 @@ class Tools
         return jjout.dump(4);
     }
 
+    // Gather on the master the update statistics of the chains of all the processes.
+    static std::vector<UpdStats_t> GatherUpdStats(const std::vector<UpdStats_t> &updStatsVecLocal)
+    {
+#ifdef HAVEMPI
+        mpi::communicator world;
+        std::vector<std::vector<UpdStats_t>> updStatsVecVec;
+        if (Rank() == master)
+        {
+            mpi::gather(world, updStatsVecLocal, updStatsVecVec, master);
+        }
+        else
+        {
+            mpi::gather(world, updStatsVecLocal, master);
+        }
+
+        std::vector<UpdStats_t> updStatsVec;
+        for (const auto &updStatsVecRank : updStatsVecVec)
+        {
+            updStatsVec.insert(updStatsVec.end(), updStatsVecRank.begin(), updStatsVecRank.end());
+        }
+        return updStatsVec;
+#else
+        return updStatsVecLocal;
+#endif
+    }
+
     static std::vector<cd_t> CubeCDToVecCD(const ClusterCubeCD_t &cubeCD)
     {
         // Print("start CubeCDToVecCD");
@@ -138,4 +169,108 @@ class Tools
     }
 };
 
+#ifdef HAVEMPI
+// The processes of comm on the same node as this one.
+mpi::communicator SplitNode(const mpi::communicator &comm)
+{
+    MPI_Comm nodeComm;
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, comm.rank(), MPI_INFO_NULL, &nodeComm);
+    return mpi::communicator(nodeComm, mpi::comm_take_ownership);
+}
+
+// size elements in one segment allocated by the rank 0 of nodeComm (see SplitNode) and mapped by all its processes, an MPI-3 shared
+// window. The construction and the destruction are collective on nodeComm. The processes write between two calls of Fence, and
+// read what the others wrote after the second one.
+template <typename T> class NodeSharedArray
+{
+  public:
+    NodeSharedArray(const size_t &size, const mpi::communicator &nodeComm)
+    {
+        const auto bytes = static_cast<MPI_Aint>((nodeComm.rank() == 0) ? size * sizeof(T) : 0);
+        void *base = nullptr;
+        MPI_Win_allocate_shared(bytes, sizeof(T), MPI_INFO_NULL, nodeComm, &base, &win_);
+
+        MPI_Aint bytesRank0 = 0;
+        int dispUnit = 0;
+        MPI_Win_shared_query(win_, 0, &bytesRank0, &dispUnit, &base);
+        assert(static_cast<size_t>(bytesRank0) == size * sizeof(T));
+        data_ = static_cast<T *>(base);
+    }
+
+    NodeSharedArray(const NodeSharedArray &array) = delete;
+    NodeSharedArray &operator=(const NodeSharedArray &array) = delete;
+
+    ~NodeSharedArray()
+    {
+        int isFinalized = 0;
+        MPI_Finalized(&isFinalized);
+        if (!isFinalized)
+        {
+            MPI_Win_free(&win_);
+        }
+    }
+
+    T *data() const { return data_; }
+
+    void Fence() const { MPI_Win_fence(0, win_); }
+
+  private:
+    MPI_Win win_;
+    T *data_{nullptr};
+};
+#endif
+
+// Ladder of U of the replica exchange, solver.temperingU (see MC::MonteCarloTempering). The processes are split in groups of
+// temperingU.size() consecutive ranks, the rank r runs at U = temperingU[r % temperingU.size()]. Without solver.temperingU,
+// the ladder is model.U only.
+class ReplicaLadder
+{
+  public:
+    explicit ReplicaLadder(const Json &jjSim)
+        : values_(jjSim["solver"].value("temperingU", std::vector<double>{jjSim["model"]["U"].get<double>()}))
+    {
+        const double targetU = jjSim["model"]["U"].get<double>();
+        const auto target =
+            std::find_if(values_.begin(), values_.end(), [&targetU](const double &uu) { return std::abs(uu - targetU) < 1e-10; });
+        if (target == values_.end())
+        {
+            throw std::runtime_error("solver.temperingU should contain model.U.");
+        }
+        targetIndex_ = static_cast<size_t>(std::distance(values_.begin(), target));
+
+        if (Tools::NWorkers() % values_.size() != 0)
+        {
+            throw std::runtime_error("The number of processes should be a multiple of the size of solver.temperingU.");
+        }
+    }
+
+    bool IsEnabled() const { return values_.size() > 1; }
+
+    size_t size() const { return values_.size(); }
+
+    // Index in the ladder of the replica of this process, and of its group of processes.
+    size_t Index() const { return Tools::Rank() % values_.size(); }
+    size_t Group() const { return Tools::Rank() / values_.size(); }
+
+    // The replicas at model.U are the ones that measure.
+    bool IsTarget() const { return Index() == targetIndex_; }
+
+    // The target replica of the first group, it writes the configuration of the next warm start (world rank targetIndex).
+    bool IsFirstTarget() const { return IsTarget() && (Group() == 0); }
+
+    double U() const { return values_.at(Index()); }
+
+    // Parameters of the simulation of this process, at its U of the ladder.
+    Json ReplicaSimulation(const Json &jjSim) const
+    {
+        Json jjReplica = jjSim;
+        jjReplica["model"]["U"] = U();
+        return jjReplica;
+    }
+
+  private:
+    std::vector<double> values_;
+    size_t targetIndex_{0};
+};
+
 } // namespace mpiUt
\ No newline at end of file
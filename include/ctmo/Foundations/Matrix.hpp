@@ -1,6 +1,10 @@
 #pragma once
 
 #include "ctmo/Foundations/Utilities.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <new>
 
 namespace LinAlg
 {
@@ -39,27 +43,73 @@ extern "C"
     unsigned int dtrtri_(char const *, char const *, unsigned int const *, double *, unsigned int const *, unsigned int const *);
     void dgesv_(const unsigned int *, const unsigned int *, double *, const unsigned int *, unsigned int *, double *, const unsigned int *,
                 int *);
+
+    // Single precision, for the mixed precision N matrices
+    unsigned int sger_(unsigned int const *, unsigned int const *, float const *, float const *, unsigned int const *, float const *,
+                       unsigned int const *, float *, unsigned int const *);
+    unsigned int sgemv_(char const *, unsigned int const *, unsigned int const *, float const *, float const *, unsigned int const *,
+                        float const *, unsigned int const *, float const *, float *, unsigned int const *);
+    unsigned int scopy_(unsigned int const *, float const *, unsigned int const *, float *, unsigned int const *);
+    unsigned int sgemm_(char const *, char const *, unsigned int const *, unsigned int const *, unsigned int const *, float const *,
+                        float const *, unsigned int const *, float const *, unsigned int const *, float const *, float *,
+                        unsigned int const *);
 }
 
+// Dense column major matrix with a capacity bigger than its size, for the N matrices which grow and shrink by one or two
+// rows and cols at each update. The memory is aligned on ALIGNMENT bytes and the leading dimension mem_n_rows() is a multiple
+// of ALIGNMENT bytes, so that every column starts on a cache line. Within the capacity, the resizes do not move anything; past
+// it, the capacity grows by ~20 % in both dimensions and only the live block is copied.
 template <typename T> class Matrix
 {
   public:
     static const size_t INIT_SIZE;
+    static const size_t ALIGNMENT = 64;
+
+    Matrix() : n_rows_(0), n_cols_(0) { Allocate(INIT_SIZE, INIT_SIZE); }
+
+    Matrix(const size_t &n_rows, const size_t &n_cols) : n_rows_(n_rows), n_cols_(n_cols) { Allocate(n_rows, n_cols); }
 
-    Matrix() : n_rows_(0), n_cols_(0), mat_(INIT_SIZE, INIT_SIZE){};
-    Matrix(const size_t &n_rows, const size_t &n_cols) : n_rows_(n_rows), n_cols_(n_cols), mat_(n_rows, n_cols) {}
+    Matrix(const arma::Mat<T> &m1) : Matrix(m1.n_rows, m1.n_cols)
+    {
+        for (size_t jj = 0; jj < n_cols_; jj++)
+        {
+            std::copy_n(m1.colptr(jj), n_rows_, Col(jj));
+        }
+    }
 
-    Matrix(const arma::Mat<T> &m1) : n_rows_(m1.n_rows), n_cols_(m1.n_cols), mat_(m1) {}
+    Matrix(const Matrix<T> &m1) : n_rows_(m1.n_rows_), n_cols_(m1.n_cols_)
+    {
+        Allocate(m1.mem_n_rows_, m1.mem_n_cols_);
+        CopyLiveBlock(m1);
+    }
 
-    Matrix(const Matrix<T> &m1) = default;
+    // m1 is left without memory, the next Resize or SetSize allocates it.
+    Matrix(Matrix<T> &&m1) noexcept : n_rows_(0), n_cols_(0) { Swap(m1); }
 
     Matrix(const arma::Mat<double> &m1, const arma::Mat<double> &m2);
 
-    Matrix<T> &operator=(const Matrix<T> &m1) = default;
+    // The memory of *this is kept if it is big enough, as with SetSize.
+    Matrix<T> &operator=(const Matrix<T> &m1)
+    {
+        if (this != &m1)
+        {
+            SetSize(m1.n_rows_, m1.n_cols_);
+            CopyLiveBlock(m1);
+        }
+        return *this;
+    }
+
+    Matrix<T> &operator=(Matrix<T> &&m1) noexcept
+    {
+        Swap(m1);
+        return *this;
+    }
+
+    ~Matrix() { Deallocate(); }
 
     Matrix(std::initializer_list<std::initializer_list<T>> initListofLists) : Matrix(arma::Mat<T>(initListofLists)) {}
 
-    static Matrix<T> DiagMat(const arma::Col<T> &v1) { return Matrix<T>(arma::diagmat(v1)); }
+    static Matrix<T> DiagMat(const arma::Col<T> &v1) { return Matrix<T>(arma::Mat<T>(arma::diagmat(v1))); }
 
     static Matrix<T> DiagMat(const size_t &size, const T &value)
     {
@@ -81,63 +131,117 @@ template <typename T> class Matrix
     inline T &operator()(const size_t &i, const size_t &j)
     {
         AssertSizes(i, j);
-        return mat_(i, j);
+        return mem_[i + j * mem_n_rows_];
     }
 
     inline const T &operator()(const size_t &i, const size_t &j) const
     {
         AssertSizes(i, j);
-        return mat_(i, j);
+        return mem_[i + j * mem_n_rows_];
     }
 
     inline size_t n_rows() const { return n_rows_; }
 
     inline size_t n_cols() const { return n_cols_; }
 
-    arma::Mat<T> mat() const { return mat_; }
+    // Copy of the live block.
+    arma::Mat<T> mat() const
+    {
+        arma::Mat<T> tmp(n_rows_, n_cols_);
+        for (size_t jj = 0; jj < n_cols_; jj++)
+        {
+            std::copy_n(Col(jj), n_rows_, tmp.colptr(jj));
+        }
+        return tmp;
+    }
 
-    inline size_t mem_n_rows() const { return mat_.n_rows; }
+    inline size_t mem_n_rows() const { return mem_n_rows_; }
 
-    inline size_t mem_n_cols() const { return mat_.n_cols; }
+    inline size_t mem_n_cols() const { return mem_n_cols_; }
 
-    T *memptr() { return mat_.memptr(); }
+    T *memptr() { return mem_; }
 
-    const T *memptr() const
-    {
-        const T *const mem_out = mat_.memptr();
-        return mem_out;
-    }
+    const T *memptr() const { return mem_; }
 
     inline void Resize(const size_t &n_rows, const size_t &n_cols)
     {
-
         if (n_rows > mem_n_rows() || n_cols > mem_n_cols())
         {
-            // Resize by ~20 % test this
-            mat_.resize(1.20 * (n_rows + 1), 1.20 * (n_cols + 1));
+            Matrix<T> tmp(GrownCapacity(mem_n_rows(), n_rows), GrownCapacity(mem_n_cols(), n_cols));
+            tmp.n_rows_ = std::min(n_rows_, n_rows);
+            tmp.n_cols_ = std::min(n_cols_, n_cols);
+            tmp.CopyLiveBlock(*this);
+            Swap(tmp);
         }
 
         n_rows_ = n_rows;
         n_cols_ = n_cols;
     }
 
+    // As Resize, without keeping the elements when the capacity grows.
     void SetSize(const size_t &n_rows, const size_t &n_cols)
     {
-
         if (n_rows > mem_n_rows() || n_cols > mem_n_cols())
         {
-            // Resize by ~20 % test this
-            mat_.set_size(1.20 * (n_rows + 1), 1.20 * (n_cols + 1));
+            const size_t mem_n_rows = GrownCapacity(mem_n_rows_, n_rows);
+            const size_t mem_n_cols = GrownCapacity(mem_n_cols_, n_cols);
+            Deallocate();
+            Allocate(mem_n_rows, mem_n_cols);
         }
 
         n_rows_ = n_rows;
         n_cols_ = n_cols;
     }
 
+    // Copy of A, converted to the precision T. The memory only grows, as with SetSize.
+    template <typename S> void CopyFrom(const Matrix<S> &A)
+    {
+        SetSize(A.n_rows(), A.n_cols());
+        for (size_t jj = 0; jj < n_cols_; jj++)
+        {
+            for (size_t ii = 0; ii < n_rows_; ii++)
+            {
+                (*this)(ii, jj) = static_cast<T>(A(ii, jj));
+            }
+        }
+    }
+
+    // For the checkpoints, with boost::serialization archives: the size then the elements, column major.
+    template <class Archive> void SaveCheckpoint(Archive &ar) const
+    {
+        std::vector<T> elements;
+        elements.reserve(n_rows_ * n_cols_);
+        for (size_t jj = 0; jj < n_cols_; jj++)
+        {
+            elements.insert(elements.end(), Col(jj), Col(jj) + n_rows_);
+        }
+        ar << n_rows_ << n_cols_ << elements;
+    }
+
+    template <class Archive> void LoadCheckpoint(Archive &ar)
+    {
+        size_t n_rows = 0;
+        size_t n_cols = 0;
+        std::vector<T> elements;
+        ar >> n_rows >> n_cols >> elements;
+        assert(elements.size() == n_rows * n_cols);
+        SetSize(n_rows, n_cols);
+        for (size_t jj = 0; jj < n_cols_; jj++)
+        {
+            std::copy_n(elements.data() + n_rows_ * jj, n_rows_, Col(jj));
+        }
+    }
+
     Matrix<T> Transpose() const
     {
-        Matrix tmp = *this;
-        tmp.mat_.t();
+        Matrix<T> tmp(n_cols_, n_rows_);
+        for (size_t jj = 0; jj < n_cols_; jj++)
+        {
+            for (size_t ii = 0; ii < n_rows_; ii++)
+            {
+                tmp(jj, ii) = (*this)(ii, jj);
+            }
+        }
         return tmp;
     }
 
@@ -145,48 +249,52 @@ template <typename T> class Matrix
 
     void CopyVectorInRow(arma::Col<T> &row, const size_t &p);
 
+    // The swaps and the removals only touch the live block: O(k) for a row or a col of a k x k matrix.
     void SwapRows(const size_t &r1, const size_t &r2)
     {
         AssertSizes(r1, r2);
-        // Change this to use dswap_ of blas, not a priority
-        mat_.swap_rows(r1, r2);
+        for (size_t jj = 0; jj < n_cols_; jj++)
+        {
+            std::swap(Col(jj)[r1], Col(jj)[r2]);
+        }
     }
 
     void SwapCols(const size_t &c1, const size_t &c2)
     {
         AssertSizes(c1, c2);
-        // Change this to use dswap_ of blas, not a priority
-        mat_.swap_cols(c1, c2);
+        std::swap_ranges(Col(c1), Col(c1) + n_rows_, Col(c2));
     }
 
     void SwapRowsAndCols(const size_t &c1, const size_t &c2)
     {
         AssertSizes(c1, c2);
-        // Change this to use dswap_ of blas, not a priority
-        mat_.swap_cols(c1, c2);
-        mat_.swap_rows(c1, c2);
+        SwapCols(c1, c2);
+        SwapRows(c1, c2);
     }
 
     void SwapToEnd(const size_t &pp)
     {
-        // Insert the row and col at index pp to the end of the matrix
+        // Insert the row and col at index pp to the end of the matrix, the order of the others is kept
         AssertSizes(pp, pp);
-
-        for (size_t ii = pp; ii < n_rows() - 1; ii++)
-        {
-            mat_.swap_cols(ii, ii + 1);
-        }
-        for (size_t ii = pp; ii < n_rows() - 1; ii++)
+        std::rotate(Col(pp), Col(pp + 1), Col(n_cols_));
+        for (size_t jj = 0; jj < n_cols_; jj++)
         {
-            mat_.swap_rows(ii, ii + 1);
+            std::rotate(Col(jj) + pp, Col(jj) + pp + 1, Col(jj) + n_rows_);
         }
     }
 
-    void Zeros() { mat_.zeros(); }
+    void Zeros() { Fill(T(0)); }
 
-    void Ones() { mat_.ones(); }
+    void Ones() { Fill(T(1)); }
 
-    void Eye() { mat_.eye(); }
+    void Eye()
+    {
+        Zeros();
+        for (size_t ii = 0; ii < std::min(n_rows_, n_cols_); ii++)
+        {
+            (*this)(ii, ii) = T(1);
+        }
+    }
 
     void Clear(const size_t &n_rows = 0, const size_t &n_cols = 0)
     {
@@ -194,24 +302,33 @@ template <typename T> class Matrix
         n_rows_ = n_cols_ = 0;
     }
 
-    void Swap(Matrix<T> &dummy)
+    void Swap(Matrix<T> &dummy) noexcept
     {
-        mat_.swap(dummy.mat_);
-        size_t tmp_row = n_rows_;
-        size_t tmp_col = n_cols_;
-        n_cols_ = dummy.n_cols_;
-        n_rows_ = dummy.n_rows_;
-        dummy.n_cols_ = tmp_col;
-        dummy.n_rows_ = tmp_row;
+        std::swap(mem_, dummy.mem_);
+        std::swap(mem_n_rows_, dummy.mem_n_rows_);
+        std::swap(mem_n_cols_, dummy.mem_n_cols_);
+        std::swap(n_rows_, dummy.n_rows_);
+        std::swap(n_cols_, dummy.n_cols_);
     }
 
-    void MultCol(const size_t &j, const double &val) { mat_.col(j) *= val; }
+    void MultCol(const size_t &j, const double &val)
+    {
+        assert(j < n_cols_);
+        for (size_t ii = 0; ii < n_rows_; ii++)
+        {
+            Col(j)[ii] *= val;
+        }
+    }
 
-    void SubMat(const size_t &r1, const size_t &c1, const size_t &r2, const size_t c2, Matrix<T> mIn)
+    void SubMat(const size_t &r1, const size_t &c1, const size_t &r2, const size_t c2, const Matrix<T> &mIn)
     {
         // copy all of the matrix  mIn to the current matrix
-        mIn.mat_.resize(mIn.n_rows_, mIn.n_cols_);
-        mat_.submat(r1, c1, r2, c2) = mIn.mat_;
+        assert(r2 - r1 + 1 == mIn.n_rows_ && c2 - c1 + 1 == mIn.n_cols_);
+        AssertSizes(r2, c2);
+        for (size_t jj = 0; jj < mIn.n_cols_; jj++)
+        {
+            std::copy_n(mIn.Col(jj), mIn.n_rows_, Col(c1 + jj) + r1);
+        }
     }
 
     void SubMat(const size_t &r1, const size_t &c1, const size_t &r2, const size_t c2, const double &val)
@@ -221,13 +338,14 @@ template <typename T> class Matrix
         const unsigned int N = c2 - c1 + 1;
         const unsigned int ld_mat = mem_n_rows();
 
-        dlaset_(&all, &M, &N, &val, &val, &(mat_.memptr()[r1 + c1 * mem_n_rows()]), &ld_mat);
+        dlaset_(&all, &M, &N, &val, &val, &(memptr()[r1 + c1 * mem_n_rows()]), &ld_mat);
     }
 
+    // Removes the row and col r, the order of the others is kept. When the order does not matter, SwapRowsAndCols with the last
+    // row and col then Resize is O(k) instead of O(k^2).
     void ShedRowAndCol(const size_t &r)
     {
-        mat_.shed_row(r);
-        mat_.shed_col(r);
+        SwapToEnd(r);
         n_rows_--;
         n_cols_--;
     }
@@ -240,7 +358,7 @@ template <typename T> class Matrix
         {
             for (size_t ii = 0; ii < n_rows(); ii++)
             {
-                mat_(ii, jj) += A(ii, jj);
+                (*this)(ii, jj) += A(ii, jj);
             }
         }
         return *this;
@@ -249,60 +367,157 @@ template <typename T> class Matrix
     // soustraction d'une matrice
     template <typename S> Matrix<T> &operator-=(const Matrix<S> &A)
     {
-        mat_ -= A.mat_;
+        assert(A.n_rows() == n_rows() && A.n_cols() == n_cols());
+
+        for (size_t jj = 0; jj < n_cols(); jj++)
+        {
+            for (size_t ii = 0; ii < n_rows(); ii++)
+            {
+                (*this)(ii, jj) -= A(ii, jj);
+            }
+        }
         return *this;
     }
 
     // multiplication par un scalaire
     inline Matrix<T> operator*=(const T &a)
     {
-        mat_ *= a;
+        for (size_t jj = 0; jj < n_cols_; jj++)
+        {
+            for (size_t ii = 0; ii < n_rows_; ii++)
+            {
+                Col(jj)[ii] *= a;
+            }
+        }
         return *this;
     }
 
     void Load(const std::string &fname)
     {
-        mat_.load(fname);
-        n_rows_ = mat_.n_rows;
-        n_cols_ = mat_.n_cols;
+        arma::Mat<T> tmp;
+        tmp.load(fname);
+        *this = Matrix<T>(tmp);
     }
 
-    // void Save(const std::string &fname) const
-    // {
-    //     arma::Mat<T> tmp = mat_.submat(0, 0, n_rows, n_cols);
-    //     tmp.save(fname, arma::raw_ascii);
-    // }
-
-    void Print() const { mat_.print(); }
+    void Print() const { mat().print(); }
 
     void Inverse();
 
-    T Determinant()
+    T Determinant() const { return arma::det(mat()); }
+
+    // Log of the absolute value of the determinant, does not overflow for big matrices like Determinant().
+    double LogAbsDeterminant() const
+    {
+        double sign = 1.0;
+        return LogAbsDeterminant(sign);
+    }
+
+    // Same as LogAbsDeterminant(), also gives the sign of the determinant.
+    double LogAbsDeterminant(double &sign) const
     {
-        mat_.resize(n_rows_, n_cols_);
-        return arma::det(mat_);
+        double logDet = 0.0;
+        arma::log_det(logDet, sign, mat());
+        return logDet;
     }
 
-    bool HasInfOrNan()
+    template <typename S> double MaxAbsDiff(const Matrix<S> &A) const
     {
-        mat_.resize(n_rows_, n_cols_);
-        return (mat_.has_nan() || mat_.has_inf());
+        assert(A.n_rows() == n_rows() && A.n_cols() == n_cols());
+        double maxDiff = 0.0;
+        for (size_t jj = 0; jj < n_cols(); jj++)
+        {
+            for (size_t ii = 0; ii < n_rows(); ii++)
+            {
+                maxDiff = std::max(maxDiff, std::abs(double((*this)(ii, jj)) - double(A(ii, jj))));
+            }
+        }
+        return maxDiff;
+    }
+
+    bool HasInfOrNan() const
+    {
+        for (size_t jj = 0; jj < n_cols_; jj++)
+        {
+            for (size_t ii = 0; ii < n_rows_; ii++)
+            {
+                if (!std::isfinite(std::abs(Col(jj)[ii])))
+                {
+                    return true;
+                }
+            }
+        }
+        return false;
     }
 
   private:
+    T *Col(const size_t &j) { return mem_ + j * mem_n_rows_; }
+
+    const T *Col(const size_t &j) const { return mem_ + j * mem_n_rows_; }
+
+    // Rounded up to a whole number of ALIGNMENT bytes, at least one.
+    static size_t Padded(const size_t &n)
+    {
+        constexpr size_t perLine = std::max(size_t(1), ALIGNMENT / sizeof(T));
+        return std::max(perLine, (n + perLine - 1) / perLine * perLine);
+    }
+
+    // Grow by ~20 %, never shrink, so that the memory only grows
+    static size_t GrownCapacity(const size_t &capacity, const size_t &n) { return std::max(capacity, size_t(1.20 * (n + 1))); }
+
+    // Zero filled, so that the elements outside of the live block are never uninitialized. posix_memalign as armadillo does, so that
+    // the allocations go through the same hook (see the allocation counting of the MarkovChain tests).
+    void Allocate(const size_t &mem_n_rows, const size_t &mem_n_cols)
+    {
+        mem_n_rows_ = Padded(mem_n_rows);
+        mem_n_cols_ = Padded(mem_n_cols);
+        const size_t nElements = mem_n_rows_ * mem_n_cols_;
+        void *mem = nullptr;
+        if (posix_memalign(&mem, ALIGNMENT, nElements * sizeof(T)) != 0)
+        {
+            throw std::bad_alloc();
+        }
+        mem_ = static_cast<T *>(mem);
+        std::uninitialized_fill_n(mem_, nElements, T(0));
+    }
+
+    void Deallocate()
+    {
+        if (mem_ != nullptr)
+        {
+            std::free(mem_);
+            mem_ = nullptr;
+        }
+        mem_n_rows_ = mem_n_cols_ = 0;
+    }
+
+    // The live block of m1 in the live block of *this, of the same size or smaller.
+    void CopyLiveBlock(const Matrix<T> &m1)
+    {
+        assert(n_rows_ <= m1.n_rows_ && n_cols_ <= m1.n_cols_);
+        for (size_t jj = 0; jj < n_cols_; jj++)
+        {
+            std::copy_n(m1.Col(jj), n_rows_, Col(jj));
+        }
+    }
+
+    void Fill(const T &value)
+    {
+        for (size_t jj = 0; jj < n_cols_; jj++)
+        {
+            std::fill_n(Col(jj), n_rows_, value);
+        }
+    }
+
     size_t n_rows_; // the real size of the matrix
     size_t n_cols_;
-    arma::Mat<T> mat_; // a matrix bigger than neccessary
+    T *mem_{nullptr}; // a matrix bigger than neccessary, column major with the leading dimension mem_n_rows_
+    size_t mem_n_rows_{0};
+    size_t mem_n_cols_{0};
 };
 
 template <typename T> const size_t Matrix<T>::INIT_SIZE = 16;
 
-template <> Matrix<cd_t>::Matrix(const arma::Mat<double> &m1, const arma::Mat<double> &m2)
-{
-    n_rows_ = m1.n_rows;
-    n_cols_ = m1.n_cols;
-    mat_ = arma::Mat<cd_t>(m1, m2);
-}
+template <> Matrix<cd_t>::Matrix(const arma::Mat<double> &m1, const arma::Mat<double> &m2) : Matrix(arma::Mat<cd_t>(m1, m2)) {}
 // addition(opérateur binaire)
 template <typename T> inline Matrix<T> operator+(const Matrix<T> &x, const Matrix<T> &y)
 {
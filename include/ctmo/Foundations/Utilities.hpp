@@ -79,4 +79,17 @@ size_t GetIndepOrbitalIndex(const size_t &o1, const size_t &o2, const size_t &NO
     return 0;
 }
 
+// FNV-1a of the size bytes at data, continued from hash. Stable from one run, compiler or machine to the other (std::hash is not), to
+// name what is saved to files.
+UInt64_t HashBytes(const void *data, const size_t &size, UInt64_t hash = 14695981039346656037ULL)
+{
+    const auto *bytes = static_cast<const unsigned char *>(data);
+    for (size_t ii = 0; ii < size; ii++)
+    {
+        hash ^= bytes[ii];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
 } // namespace Utilities
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <boost/random.hpp>
+#include <sstream>
+#include <string>
 
 namespace Utilities
 {
@@ -11,4 +13,18 @@ using UniformDistribution_t = boost::uniform_real<double>;
 using UniformRngMt19937_t = boost::variate_generator<EngineTypeMt19937_t &, UniformDistribution_t>;
 using UniformRngFibonacci3217_t = boost::variate_generator<EngineTypeFibonacci3217_t &, UniformDistribution_t>;
 
+// State of a random engine as text, for the checkpoints.
+template <typename TEngine_t> std::string EngineState(const TEngine_t &engine)
+{
+    std::ostringstream oss;
+    oss << engine;
+    return oss.str();
+}
+
+template <typename TEngine_t> void SetEngineState(TEngine_t &engine, const std::string &state)
+{
+    std::istringstream iss(state);
+    iss >> engine;
+}
+
 } // namespace Utilities
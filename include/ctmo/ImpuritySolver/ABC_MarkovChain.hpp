@@ -2,7 +2,11 @@
 
 #include "ctmo/Foundations/UtilitiesRandom.hpp"
 #include "ctmo/Foundations/Matrix.hpp"
+#include "ctmo/Foundations/DelayedUpdate.hpp"
 #include "ctmo/Foundations/GreenTau.hpp"
+#include "ctmo/ImpuritySolver/ConfigSnapshot.hpp"
+#include <iterator>
+#include <sstream>
 
 #ifdef SLMC
 #include "ctmo/ImpuritySolver/ConfigParser.hpp"
@@ -17,49 +21,79 @@ using Fourier::MatToTau;
 using Fourier::MatToTauCluster;
 using Vertex = Diagrammatic::Vertex;
 using VertexPart = Diagrammatic::VertexPart;
+using VertexPartStore = Diagrammatic::VertexPartStore;
 
 using Matrix_t = LinAlg::Matrix_t;
 
-struct UpdData
+// Scratch memory of the updates, reused from one step to the next so that the steps do not allocate.
+template <typename TNScalar_t> struct UpdData
 {
 
     UpdData() = default;
-    SiteVector_t NQUp_;
-    SiteVector_t NQDown_;
-    SiteVector_t newLastRowUp_;
-    SiteVector_t newLastRowDown_;
+    LinAlg::ScratchVector NQUp_;
+    LinAlg::ScratchVector NQDown_;
+    LinAlg::ScratchVector newLastRowUp_;
+    LinAlg::ScratchVector newLastRowDown_;
+    LinAlg::ScratchVector newLastCol_;
     double sTildeUpI_{0.0};
     double sTildeDownI_{0.0};
+
+    Matrix_t Q_; // insertions of vertices with parts of the same spin
+    Matrix_t R_;
+    Matrix_t NQ_;
+    Matrix_t sTilde_;
+    LinAlg::BlockWorkspaceT<TNScalar_t> workspace_;
+    GreenTau::BatchScratch green0Scratch_;
 };
 
-struct NFData
+// TNScalar_t is the precision of the N matrices, double or float (mixed precision, resynced in double by the clean updates).
+template <typename TNScalar_t> struct NFData
 {
 
     NFData() = default;
-    SiteVector_t FVup_;
-    SiteVector_t FVdown_;
-    Matrix_t Nup_;
-    Matrix_t Ndown_;
-    Matrix_t dummy_;
+    std::vector<double> FVup_; // std::vector, so that the memory is kept when the expansion order goes down
+    std::vector<double> FVdown_;
+    LinAlg::Matrix<TNScalar_t> Nup_;
+    LinAlg::Matrix<TNScalar_t> Ndown_;
+    Matrix_t dummy_; // N^-1 of the clean updates, always in double
 };
 
-class ABC_MarkovChain
+// Base of the markov chains, TMarkovChain_t is the derived chain (CRTP). It gives FAux, FAuxBar and gamma, so that they are
+// inlined in the updates.
+// TNScalar_t is the precision of the N matrices: double, or float for the mixed precision mode.
+template <typename TMarkovChain_t, typename TNScalar_t> class ABC_MarkovChain
 {
 
     using GreenTau_t = GreenTau::GreenCluster0Tau;
     using Model_t = Models::ABC_Model_2D;
+    using NMatrix_t = LinAlg::Matrix<TNScalar_t>;
 
   public:
     const double PROBINSERT = 0.3333333333;
     const double PROBREMOVE = 1.0 - PROBINSERT;
 
-    ABC_MarkovChain(const Json &jj, const size_t &seed)
-        : modelPtr_(new Model_t(jj)), rng_(seed), urng_(rng_, Utilities::UniformDistribution_t(0.0, 1.0)),
-          dataCT_(new Obs::ISDataCT(jj, modelPtr_)), obs_(dataCT_, jj), vertexBuilder_(jj, modelPtr_->Nc()),
+    ABC_MarkovChain(const Json &jj, const size_t &seed) : ABC_MarkovChain(jj, seed, std::make_shared<Obs::ISDataCT>(jj, std::make_shared<Model_t>(jj)), 0)
+    {
+    }
+
+    // Chain sharing the model and the G0 tables of another chain of the same process, for the threaded chains.
+    ABC_MarkovChain(const Json &jj, const size_t &seed, const ABC_MarkovChain &shared)
+        : ABC_MarkovChain(jj, seed, shared.dataCT_->ShareTables(), seed)
+    {
+    }
+
+    ABC_MarkovChain(const Json &jj, const size_t &seed, const std::shared_ptr<Obs::ISDataCT> &dataCT, const size_t &obsSeedShift)
+        : modelPtr_(dataCT->modelPtr_), rng_(seed), urng_(rng_, Utilities::UniformDistribution_t(0.0, 1.0)), dataCT_(dataCT),
+          obs_(dataCT_, jj, obsSeedShift), vertexBuilder_(jj, modelPtr_->Nc()),
 #ifdef SLMC
-          configParser_(jj["slmc"]), logDeterminant_(0.0),
+          configParser_(jj["slmc"]),
 #endif
-          updsamespin_(0), isOneOrbitalOptimized_(jj["solver"]["isOneOrbitalOptimized"].get<bool>())
+          logDeterminant_(0.0),
+          updsamespin_(0), isOneOrbitalOptimized_(jj["solver"]["isOneOrbitalOptimized"].get<bool>()),
+          delayedUp_(jj["solver"].value("kMaxUpd", size_t(0))), delayedDown_(jj["solver"].value("kMaxUpd", size_t(0))),
+          probFlip_(jj["solver"].value("probFlip", 0.0)), cleanUpdatePivot_(jj["solver"].value("cleanUpdatePivot", 1e-8)),
+          modelHash_(Diagrammatic::ConfigSnapshot::Hash(jj["model"].dump())),
+          isConfigCompressed_(jj["monteCarlo"].value("configCompression", false))
     {
         const std::valarray<size_t> zeroPair = {0, 0};
         updStats_["Inserts"] = zeroPair;
@@ -77,6 +111,18 @@ class ABC_MarkovChain
         {
             Logging::Trace("Optimized for one orbital and will crash if not One-band Hubbard Model.");
         }
+        if (delayedUp_.IsEnabled())
+        {
+            Logging::Info("Delayed updates, kMaxUpd = " + std::to_string(delayedUp_.maxDelay()));
+        }
+        if (std::is_same<TNScalar_t, float>::value)
+        {
+            Logging::Info("Mixed precision, the N matrices are in single precision between the clean updates.");
+        }
+        if ((probFlip_ < 0.0) || (probFlip_ > 1.0))
+        {
+            throw std::runtime_error("probFlip should be in [0, 1].");
+        }
         Logging::Debug("MarkovChain Created.");
     }
 
@@ -85,34 +131,66 @@ class ABC_MarkovChain
     ABC_MarkovChain(ABC_MarkovChain &&abc_markovChain) = default;
     ABC_MarkovChain &operator=(ABC_MarkovChain &&abc_markovChain) = delete;
 
-    virtual ~ABC_MarkovChain() = default;
+    ~ABC_MarkovChain() = default;
 
     // Getters
     Model_t model() const { return (*modelPtr_); }
 
-    Matrix_t Nup() const { return nfdata_.Nup_; }
+    Matrix_t Nup() const { return delayedUp_.Materialize(nfdata_.Nup_); }
 
-    Matrix_t Ndown() const { return nfdata_.Ndown_; }
+    Matrix_t Ndown() const { return delayedDown_.Materialize(nfdata_.Ndown_); }
 
     size_t updatesProposed() const { return updatesProposed_; }
 
+    UpdStats_t updStats() const { return updStats_; }
+
     double beta() const { return dataCT_->beta_; }
 
-#ifdef SLMC
     double logDeterminant() const { return logDeterminant_; }
+
+    Sign_t sign() const { return dataCT_->sign_; }
+
+    size_t expansionOrder() const { return dataCT_->vertices_.size(); }
+
+    // The scalars of the last measurement, for the target accuracy of the monte carlo (see MC::AccuracyTarget). With SLMC, the sign
+    // and the expansion order only.
+    std::array<double, 4> MeasuredScalars() const
+    {
+#ifdef SLMC
+        const auto sign = static_cast<double>(dataCT_->sign_);
+        return {sign, sign * static_cast<double>(expansionOrder()), 0.0, 0.0};
+#else
+        return obs_.MeasuredScalars();
 #endif
+    }
 
-    // End Getters
-    virtual double FAux(const VertexPart &vPart) const = 0;
+    // Number of updates proposed between the measurements, set by the monte carlo after the thermalization.
+    size_t updatesMeas() const { return obs_.updatesMeas(); }
+
+    void SetUpdatesMeas(const size_t &updatesMeas, const double &autocorrelationTime)
+    {
+        obs_.SetUpdatesMeas(updatesMeas, autocorrelationTime);
+    }
 
-    virtual double FAuxBar(const VertexPart &vPart) const = 0;
+    // Max deviation between the fast-updated N matrices and the ones recomputed by the last CleanUpdate.
+    double cleanUpdateDrift() const { return cleanUpdateDrift_; }
 
-    virtual double gamma(const VertexPart &vpI, const VertexPart &vpJ) const = 0; // little gamma
+    // An accepted update divided by a pivot smaller than cleanUpdatePivot, the N matrices should be recomputed.
+    bool needsCleanUpdate() const { return needsCleanUpdate_; }
+
+    // End Getters
+    const TMarkovChain_t &Derived() const { return static_cast<const TMarkovChain_t &>(*this); }
 
     void DoStep()
     {
-
-        urng_() < PROBINSERT ? InsertVertex() : RemoveVertex();
+        if ((probFlip_ > 0.0) && (urng_() < probFlip_))
+        {
+            FlipAuxSpin();
+        }
+        else
+        {
+            urng_() < PROBINSERT ? InsertVertex() : RemoveVertex();
+        }
         updatesProposed_++;
     }
 
@@ -122,10 +200,10 @@ class ABC_MarkovChain
         assert(nfdata_.Nup_.n_rows() + nfdata_.Ndown_.n_rows() == 2 * kk);
         assert(2 * dataCT_->vertices_.size() == dataCT_->vertices_.NUp() + dataCT_->vertices_.NDown());
 
-        assert(dataCT_->vertices_.NUp() == nfdata_.FVup_.n_elem);
+        assert(dataCT_->vertices_.NUp() == nfdata_.FVup_.size());
         assert(dataCT_->vertices_.NUp() == nfdata_.Nup_.n_rows());
 
-        assert(dataCT_->vertices_.NDown() == nfdata_.FVdown_.n_elem);
+        assert(dataCT_->vertices_.NDown() == nfdata_.FVdown_.size());
         assert(dataCT_->vertices_.NDown() == nfdata_.Ndown_.n_rows());
     }
 
@@ -150,7 +228,7 @@ class ABC_MarkovChain
 
     void CalculateUpdDataInsertDiffSpin(const VertexPart &x)
     {
-        const double faux = FAux(x);
+        const double faux = Derived().FAux(x);
         const double fauxM1 = faux - 1.0;
 
         if (x.spin() == FermionSpin_t::Up)
@@ -160,17 +238,18 @@ class ABC_MarkovChain
             if (static_cast<bool>(nfdata_.Nup_.n_rows()))
             {
                 const size_t kkoldUp = dataCT_->vertices_.NUp();
-                upddata_.newLastRowUp_.set_size(kkoldUp);
-                SiteVector_t newLastColUp_(kkoldUp);
-                upddata_.NQUp_.set_size(kkoldUp);
+                SiteVector_t newLastRowUp = upddata_.newLastRowUp_.View(kkoldUp);
+                SiteVector_t newLastColUp = upddata_.newLastCol_.View(kkoldUp);
+                SiteVector_t NQUp = upddata_.NQUp_.View(kkoldUp);
 
-                for (size_t iUp = 0; iUp < dataCT_->vertices_.NUp(); iUp++)
+                GetGreenTau0RowCol(x, newLastRowUp.memptr(), newLastColUp.memptr());
+                for (size_t iUp = 0; iUp < kkoldUp; iUp++)
                 {
-                    upddata_.newLastRowUp_(iUp) = GetGreenTau0(x, dataCT_->vertices_.atUp(iUp)) * (nfdata_.FVup_(iUp) - 1.0);
-                    newLastColUp_(iUp) = GetGreenTau0(dataCT_->vertices_.atUp(iUp), x) * fauxM1;
+                    newLastRowUp(iUp) *= nfdata_.FVup_[iUp] - 1.0;
+                    newLastColUp(iUp) *= fauxM1;
                 }
-                MatrixVectorMult(nfdata_.Nup_, newLastColUp_, 1.0, upddata_.NQUp_);
-                upddata_.sTildeUpI_ -= LinAlg::DotVectors(upddata_.newLastRowUp_, upddata_.NQUp_);
+                delayedUp_.MatrixVectorMult(nfdata_.Nup_, newLastColUp, NQUp);
+                upddata_.sTildeUpI_ -= LinAlg::DotVectors(newLastRowUp, NQUp);
             }
         }
         else
@@ -180,18 +259,19 @@ class ABC_MarkovChain
             if (static_cast<bool>(nfdata_.Ndown_.n_rows()))
             {
                 const size_t kkoldDown = dataCT_->vertices_.NDown();
-                upddata_.newLastRowDown_.set_size(kkoldDown);
-                SiteVector_t newLastColDown_(kkoldDown);
-                upddata_.NQDown_.set_size(kkoldDown);
+                SiteVector_t newLastRowDown = upddata_.newLastRowDown_.View(kkoldDown);
+                SiteVector_t newLastColDown = upddata_.newLastCol_.View(kkoldDown);
+                SiteVector_t NQDown = upddata_.NQDown_.View(kkoldDown);
 
-                for (size_t iDown = 0; iDown < dataCT_->vertices_.NDown(); iDown++)
+                GetGreenTau0RowCol(x, newLastRowDown.memptr(), newLastColDown.memptr());
+                for (size_t iDown = 0; iDown < kkoldDown; iDown++)
                 {
-                    upddata_.newLastRowDown_(iDown) = GetGreenTau0(x, dataCT_->vertices_.atDown(iDown)) * (nfdata_.FVdown_(iDown) - 1.0);
-                    newLastColDown_(iDown) = GetGreenTau0(dataCT_->vertices_.atDown(iDown), x) * fauxM1;
+                    newLastRowDown(iDown) *= nfdata_.FVdown_[iDown] - 1.0;
+                    newLastColDown(iDown) *= fauxM1;
                 }
 
-                MatrixVectorMult(nfdata_.Ndown_, newLastColDown_, 1.0, upddata_.NQDown_);
-                upddata_.sTildeDownI_ -= LinAlg::DotVectors(upddata_.newLastRowDown_, upddata_.NQDown_);
+                delayedDown_.MatrixVectorMult(nfdata_.Ndown_, newLastColDown, NQDown);
+                upddata_.sTildeDownI_ -= LinAlg::DotVectors(newLastRowDown, NQDown);
             }
         }
     }
@@ -205,8 +285,8 @@ class ABC_MarkovChain
         const size_t kknewUp = kkoldUp + 1;
         const size_t kkoldDown = nfdata_.Ndown_.n_rows();
         const size_t kknewDown = kkoldDown + 1;
-        const double fauxup = FAux(vertexPartUp);
-        const double fauxdown = FAux(vertexPartDown);
+        const double fauxup = Derived().FAux(vertexPartUp);
+        const double fauxdown = Derived().FAux(vertexPartDown);
 
         CalculateUpdDataInsertDiffSpin(vertexPartUp);
         CalculateUpdDataInsertDiffSpin(vertexPartDown);
@@ -217,51 +297,59 @@ class ABC_MarkovChain
         if (urng_() < std::abs(ratioAcc))
         {
             AssertSizes();
-#ifdef SLMC
-            logDeterminant_ += std::log(std::abs(ratio));
-
-#endif
+            AcceptRatio(ratio);
             updStats_["Inserts"][1]++;
             if (ratioAcc < 0.0)
             {
                 dataCT_->sign_ *= -1;
             }
 
-            if (static_cast<bool>(nfdata_.Nup_.n_rows()))
-            {
-                LinAlg::BlockRankOneUpgrade(nfdata_.Nup_, upddata_.NQUp_, upddata_.newLastRowUp_, 1.0 / upddata_.sTildeUpI_);
-                nfdata_.FVup_.resize(kknewUp);
-                nfdata_.FVup_(kkoldUp) = fauxup;
-            }
-            else
-            {
-                nfdata_.Nup_ = Matrix_t(1, 1);
-                nfdata_.Nup_(0, 0) = 1.0 / upddata_.sTildeUpI_;
-                nfdata_.FVup_ = SiteVector_t(1);
-                nfdata_.FVup_(0) = fauxup;
-            }
+            // Views on the vectors computed by CalculateUpdDataInsertDiffSpin
+            const SiteVector_t NQUp = upddata_.NQUp_.View(kkoldUp);
+            const SiteVector_t newLastRowUp = upddata_.newLastRowUp_.View(kkoldUp);
+            const SiteVector_t NQDown = upddata_.NQDown_.View(kkoldDown);
+            const SiteVector_t newLastRowDown = upddata_.newLastRowDown_.View(kkoldDown);
 
-            if (static_cast<bool>(nfdata_.Ndown_.n_rows()))
+            if (delayedUp_.IsEnabled())
             {
-                LinAlg::BlockRankOneUpgrade(nfdata_.Ndown_, upddata_.NQDown_, upddata_.newLastRowDown_, 1.0 / upddata_.sTildeDownI_);
-                nfdata_.FVdown_.resize(kknewDown);
-                nfdata_.FVdown_(kkoldDown) = fauxdown;
+                delayedUp_.Upgrade(nfdata_.Nup_, NQUp, newLastRowUp, 1.0 / upddata_.sTildeUpI_);
+                delayedDown_.Upgrade(nfdata_.Ndown_, NQDown, newLastRowDown, 1.0 / upddata_.sTildeDownI_);
             }
             else
             {
-                nfdata_.Ndown_ = Matrix_t(1, 1);
-                nfdata_.Ndown_(0, 0) = 1.0 / upddata_.sTildeDownI_;
+                if (static_cast<bool>(nfdata_.Nup_.n_rows()))
+                {
+                    LinAlg::BlockRankOneUpgrade(nfdata_.Nup_, NQUp, newLastRowUp, 1.0 / upddata_.sTildeUpI_, upddata_.workspace_);
+                }
+                else
+                {
+                    nfdata_.Nup_.SetSize(1, 1);
+                    nfdata_.Nup_(0, 0) = 1.0 / upddata_.sTildeUpI_;
+                }
 
-                nfdata_.FVdown_ = SiteVector_t(1);
-                nfdata_.FVdown_(0) = fauxdown;
+                if (static_cast<bool>(nfdata_.Ndown_.n_rows()))
+                {
+                    LinAlg::BlockRankOneUpgrade(nfdata_.Ndown_, NQDown, newLastRowDown, 1.0 / upddata_.sTildeDownI_, upddata_.workspace_);
+                }
+                else
+                {
+                    nfdata_.Ndown_.SetSize(1, 1);
+                    nfdata_.Ndown_(0, 0) = 1.0 / upddata_.sTildeDownI_;
+                }
             }
+            nfdata_.FVup_.push_back(fauxup);
+            nfdata_.FVdown_.push_back(fauxdown);
+            assert(nfdata_.FVup_.size() == kknewUp);
+            assert(nfdata_.FVdown_.size() == kknewDown);
 
             dataCT_->vertices_.AppendVertex(vertex);
+            FlushIfFull();
         }
     }
 
-    void InsertVertexSameSpin(const Vertex &vertex, Matrix_t &Nspin, SiteVector_t &FVspin)
+    void InsertVertexSameSpin(const Vertex &vertex, NMatrix_t &Nspin, std::vector<double> &FVspin)
     {
+        FlushDelayed();
         const VertexPart x = vertex.vStart();
         const VertexPart y = vertex.vEnd();
 
@@ -272,9 +360,9 @@ class ABC_MarkovChain
 
         assert(x.spin() == y.spin());
 
-        const double faux = FAux(x);
+        const double faux = Derived().FAux(x);
         const double fauxM1 = faux - 1.0;
-        const double fauxBar = FAuxBar(x);
+        const double fauxBar = Derived().FAuxBar(x);
         const double fauxM1Bar = fauxBar - 1.0;
 
         const double s00 = -faux + GetGreenTau0(x, x) * fauxM1;
@@ -282,6 +370,13 @@ class ABC_MarkovChain
         const double s10 = GetGreenTau0(y, x) * fauxM1;
         const double s11 = -fauxBar + GetGreenTau0(y, y) * fauxM1Bar;
 
+        Matrix_t &sTilde = upddata_.sTilde_; // 2x2, its capacity is never exceeded
+        sTilde.SetSize(2, 2);
+        sTilde(0, 0) = s00;
+        sTilde(0, 1) = s01;
+        sTilde(1, 0) = s10;
+        sTilde(1, 1) = s11;
+
         if (static_cast<bool>(Nspin.n_rows()))
         {
             assert(Nspin.n_rows());
@@ -289,36 +384,38 @@ class ABC_MarkovChain
             const size_t kknew = kkold + 1;
             const size_t kkoldspin = Nspin.n_rows();
 
-            Matrix_t Q_(kkoldspin, 2);
-            Matrix_t R_(2, kkoldspin);
-
+            Matrix_t &Q_ = upddata_.Q_;
+            Matrix_t &R_ = upddata_.R_;
+            Matrix_t &NQ_ = upddata_.NQ_; // NQ = N*Q
+            Q_.SetSize(kkoldspin, 2);
+            R_.SetSize(2, kkoldspin);
+            NQ_.SetSize(kkoldspin, 2);
+
+            // The columns of Q are contiguous, the rows of R go through the scratch vectors first.
+            assert(dataCT_->vertices_.parts(x.spin()).size() == kkoldspin);
+            SiteVector_t rowX = upddata_.newLastRowUp_.View(kkoldspin);
+            SiteVector_t rowY = upddata_.newLastRowDown_.View(kkoldspin);
+            GetGreenTau0RowCol(x, rowX.memptr(), Q_.memptr());
+            GetGreenTau0RowCol(y, rowY.memptr(), Q_.memptr() + Q_.mem_n_rows());
             for (size_t i = 0; i < kkoldspin; i++)
             {
-
-                const VertexPart vPartI = (x.spin() == FermionSpin_t::Up) ? dataCT_->vertices_.atUp(i) : dataCT_->vertices_.atDown(i);
-                const double fauxIm1 = FVspin(i) - 1.0; // Faux_i - 1.0
-                Q_(i, 0) = GetGreenTau0(vPartI, x) * fauxM1;
-                Q_(i, 1) = GetGreenTau0(vPartI, y) * fauxM1Bar;
-
-                assert(vPartI.spin() == x.spin());
-
-                R_(0, i) = GetGreenTau0(x, vPartI) * fauxIm1;
-                R_(1, i) = GetGreenTau0(y, vPartI) * fauxIm1;
+                const double fauxIm1 = FVspin[i] - 1.0; // Faux_i - 1.0
+                Q_(i, 0) *= fauxM1;
+                Q_(i, 1) *= fauxM1Bar;
+                R_(0, i) = rowX(i) * fauxIm1;
+                R_(1, i) = rowY(i) * fauxIm1;
             }
 
-            Matrix_t NQ_(kkoldspin, 2); // NQ = N*Q
-            NQ_.Zeros();
-            DGEMM(1.0, 0.0, Nspin, Q_, NQ_);
+            LinAlg::MatrixMatrixMult(Nspin, Q_, NQ_, upddata_.workspace_);
 
-            Matrix_t sTilde(2, 2);
-            DGEMM(-1.0, 0.0, R_, NQ_, sTilde);
-            sTilde += Matrix_t({{s00, s01}, {s10, s11}});
-            sTilde.Inverse();
+            DGEMM(-1.0, 1.0, R_, NQ_, sTilde);
+            LinAlg::Inverse2x2(sTilde);
 
             const double ratioAcc = PROBREMOVE / PROBINSERT * vertex.probProb() / kknew * 1.0 / sTilde.Determinant();
             if (urng_() < std::abs(ratioAcc))
             {
                 AssertSizes();
+                AcceptRatio(1.0 / sTilde.Determinant());
 
                 updStats_["Inserts"][1]++;
                 if (ratioAcc < .0)
@@ -326,31 +423,32 @@ class ABC_MarkovChain
                     dataCT_->sign_ *= -1;
                 }
 
-                LinAlg::BlockRankTwoUpgrade(Nspin, NQ_, R_, sTilde);
-                FVspin.resize(kkoldspin + 2);
-                FVspin(kkoldspin) = faux;
-                FVspin(kkoldspin + 1) = fauxBar;
+                LinAlg::BlockRankTwoUpgrade(Nspin, NQ_, R_, sTilde, upddata_.workspace_);
+                FVspin.push_back(faux);
+                FVspin.push_back(fauxBar);
                 dataCT_->vertices_.AppendVertex(vertex);
                 updsamespin_++;
             }
         }
         else
         {
-            Matrix_t sTilde = Matrix_t({{s00, s01}, {s10, s11}});
-            sTilde.Inverse();
+            LinAlg::Inverse2x2(sTilde);
             const double ratioAcc = PROBREMOVE / PROBINSERT * vertex.probProb() * 1.0 / sTilde.Determinant();
             if (urng_() < std::abs(ratioAcc))
             {
+                AcceptRatio(1.0 / sTilde.Determinant());
                 if (ratioAcc < 0.0)
                 {
                     dataCT_->sign_ *= -1;
                 }
 
-                Nspin = sTilde;
+                Nspin.SetSize(2, 2);
+                Nspin(0, 0) = sTilde(0, 0);
+                Nspin(0, 1) = sTilde(0, 1);
+                Nspin(1, 0) = sTilde(1, 0);
+                Nspin(1, 1) = sTilde(1, 1);
 
-                FVspin = SiteVector_t(2);
-                FVspin(0) = faux;
-                FVspin(1) = fauxBar;
+                FVspin.assign({faux, fauxBar});
 
                 dataCT_->vertices_.AppendVertex(vertex);
             }
@@ -391,9 +489,8 @@ class ABC_MarkovChain
 
         if (!isOneOrbitalOptimized_)
         {
-            const UInt64_t vertexKey = dataCT_->vertices_.GetKey(pp);
-            ppUp = dataCT_->vertices_.GetKeyIndex(vertexKey, FermionSpin_t::Up);
-            ppDown = dataCT_->vertices_.GetKeyIndex(vertexKey, FermionSpin_t::Down);
+            ppUp = dataCT_->vertices_.PartIndex(pp, FermionSpin_t::Up);
+            ppDown = dataCT_->vertices_.PartIndex(pp, FermionSpin_t::Down);
         }
 
         const auto x = dataCT_->vertices_.atUp(ppUp);
@@ -407,16 +504,13 @@ class ABC_MarkovChain
             assert(std::abs(x.tau() - y.tau()) < 1e-14);
         }
 
-        const double ratio = nfdata_.Nup_(ppUp, ppUp) * nfdata_.Ndown_(ppDown, ppDown);
+        const double ratio = delayedUp_.Element(nfdata_.Nup_, ppUp, ppUp) * delayedDown_.Element(nfdata_.Ndown_, ppDown, ppDown);
         const double ratioAcc = PROBINSERT / PROBREMOVE * static_cast<double>(dataCT_->vertices_.size()) / vertex.probProb() * ratio;
 
         if (urng_() < std::abs(ratioAcc))
         {
 
-#ifdef SLMC
-            logDeterminant_ += std::log(std::abs(ratio));
-
-#endif
+            AcceptRatio(ratio);
             updStats_["Removes"][1]++;
             if (ratioAcc < .0)
             {
@@ -432,28 +526,37 @@ class ABC_MarkovChain
             dataCT_->vertices_.SwapVertexPart(ppUp, kkUpm1, x.spin());
             dataCT_->vertices_.SwapVertexPart(ppDown, kkDownm1, y.spin());
 
-            LinAlg::BlockRankOneDowngrade(nfdata_.Nup_, ppUp);
-            LinAlg::BlockRankOneDowngrade(nfdata_.Ndown_, ppDown);
-            nfdata_.FVup_.swap_rows(ppUp, kkUpm1);
-            nfdata_.FVdown_.swap_rows(ppDown, kkDownm1);
-            nfdata_.FVup_.resize(kkUpm1);
-            nfdata_.FVdown_.resize(kkDownm1);
+            if (delayedUp_.IsEnabled())
+            {
+                delayedUp_.Downgrade(nfdata_.Nup_, ppUp);
+                delayedDown_.Downgrade(nfdata_.Ndown_, ppDown);
+            }
+            else
+            {
+                LinAlg::BlockRankOneDowngrade(nfdata_.Nup_, ppUp, upddata_.workspace_);
+                LinAlg::BlockRankOneDowngrade(nfdata_.Ndown_, ppDown, upddata_.workspace_);
+            }
+            std::swap(nfdata_.FVup_[ppUp], nfdata_.FVup_[kkUpm1]);
+            std::swap(nfdata_.FVdown_[ppDown], nfdata_.FVdown_[kkDownm1]);
+            nfdata_.FVup_.pop_back();
+            nfdata_.FVdown_.pop_back();
 
             dataCT_->vertices_.RemoveVertex(pp);
             dataCT_->vertices_.PopBackVertexPart(x.spin());
             dataCT_->vertices_.PopBackVertexPart(y.spin());
+            FlushIfFull();
 
             AssertSizes();
         }
     }
 
-    void RemoveVertexSameSpin(const size_t &pp, Matrix_t &Nspin, SiteVector_t &FVspin)
+    void RemoveVertexSameSpin(const size_t &pp, NMatrix_t &Nspin, std::vector<double> &FVspin)
     {
+        FlushDelayed();
         assert(Nspin.n_rows() >= 2);
-        assert(FVspin.n_elem >= 2);
+        assert(FVspin.size() >= 2);
 
         const Vertex vertex = dataCT_->vertices_.at(pp);
-        const UInt64_t vertexKey = dataCT_->vertices_.GetKey(pp);
         const VertexPart x = vertex.vStart();
         const VertexPart y = vertex.vEnd();
         assert(x.spin() == y.spin());
@@ -467,8 +570,8 @@ class ABC_MarkovChain
 
         assert(x.site() == y.site());
 
-        const size_t pp1Spin = dataCT_->vertices_.GetKeyIndex(vertexKey, x.spin());
-        const size_t pp2Spin = dataCT_->vertices_.GetKeyIndex(vertexKey + 1, y.spin());
+        const size_t pp1Spin = dataCT_->vertices_.PartIndex(pp, false);
+        const size_t pp2Spin = dataCT_->vertices_.PartIndex(pp, true);
         const size_t kk = dataCT_->vertices_.size();
         const size_t kkSpin = (x.spin() == FermionSpin_t::Up) ? dataCT_->vertices_.NUp() : dataCT_->vertices_.NDown();
         const size_t kkSpinm1 = kkSpin - 1;
@@ -481,6 +584,7 @@ class ABC_MarkovChain
         if (urng_() < std::abs(ratioAcc))
         {
             AssertSizes();
+            AcceptRatio(arma::det(STildeInverse));
             updStats_["Removes"][1]++;
             if (ratioAcc < 0.0)
             {
@@ -488,12 +592,12 @@ class ABC_MarkovChain
             }
 
             dataCT_->vertices_.SwapVertexPart(pp2Spin, kkSpinm1, x.spin());
-            FVspin.swap_rows(pp2Spin, kkSpinm1);
+            std::swap(FVspin[pp2Spin], FVspin[kkSpinm1]);
             Nspin.SwapRowsAndCols(pp2Spin, kkSpinm1);
 
-            const size_t pp1SpinNew = dataCT_->vertices_.GetKeyIndex(vertexKey, y.spin());
+            const size_t pp1SpinNew = dataCT_->vertices_.PartIndex(pp, false);
             dataCT_->vertices_.SwapVertexPart(pp1SpinNew, kkSpinm2, y.spin());
-            FVspin.swap_rows(pp1SpinNew, kkSpinm2);
+            std::swap(FVspin[pp1SpinNew], FVspin[kkSpinm2]);
             Nspin.SwapRowsAndCols(pp1SpinNew, kkSpinm2);
 
             LinAlg::BlockRankTwoDowngrade(Nspin);
@@ -504,81 +608,410 @@ class ABC_MarkovChain
             dataCT_->vertices_.PopBackVertexPart(x.spin());
             dataCT_->vertices_.PopBackVertexPart(y.spin());
 
-            assert(Nspin.n_rows() == FVspin.n_elem);
+            assert(Nspin.n_rows() == FVspin.size());
+        }
+    }
+
+    // Flip the aux spin of a random vertex. Only the electron-electron vertices with parts of different spins are flipped, each N
+    // matrix then changes by a rank-one update: N' = N - lambda/ratio * (e_p + N(:, p)) N(p, :), with lambda = (F'_p - F_p)/(F_p - 1).
+    // The weight of a phonon vertex also depends on its aux spin through probProb, those are left to the insertions and removals.
+    void FlipAuxSpin()
+    {
+        AssertSizes();
+        const size_t kk = dataCT_->vertices_.size();
+        if (!static_cast<bool>(kk))
+        {
+            return;
+        }
+
+        const auto pp = static_cast<size_t>(urng_() * kk);
+        const Vertex vertex = dataCT_->vertices_.at(pp);
+        if ((vertex.vStart().spin() == vertex.vEnd().spin()) || (vertex.vtype() == Diagrammatic::VertexType::Phonon))
+        {
+            return;
+        }
+        updStats_["Flips"][0]++;
+
+        size_t ppUp = pp;
+        size_t ppDown = pp;
+        if (!isOneOrbitalOptimized_)
+        {
+            ppUp = dataCT_->vertices_.PartIndex(pp, FermionSpin_t::Up);
+            ppDown = dataCT_->vertices_.PartIndex(pp, FermionSpin_t::Down);
+        }
+
+        VertexPart x = dataCT_->vertices_.atUp(ppUp);
+        VertexPart y = dataCT_->vertices_.atDown(ppDown);
+        x.FlipAux();
+        y.FlipAux();
+        const double fauxUp = Derived().FAux(x);
+        const double fauxDown = Derived().FAux(y);
+
+        const double lambdaUp = (fauxUp - nfdata_.FVup_[ppUp]) / (nfdata_.FVup_[ppUp] - 1.0);
+        const double lambdaDown = (fauxDown - nfdata_.FVdown_[ppDown]) / (nfdata_.FVdown_[ppDown] - 1.0);
+        const double ratioUp = 1.0 + lambdaUp * (1.0 + delayedUp_.Element(nfdata_.Nup_, ppUp, ppUp));
+        const double ratioDown = 1.0 + lambdaDown * (1.0 + delayedDown_.Element(nfdata_.Ndown_, ppDown, ppDown));
+        const double ratioAcc = ratioUp * ratioDown;
+
+        if (urng_() < std::abs(ratioAcc))
+        {
+            AcceptRatio(ratioAcc);
+            updStats_["Flips"][1]++;
+            if (ratioAcc < 0.0)
+            {
+                dataCT_->sign_ *= -1;
+            }
+
+            FlipAuxSpinPart(ppUp, -lambdaUp / ratioUp, nfdata_.Nup_, delayedUp_);
+            FlipAuxSpinPart(ppDown, -lambdaDown / ratioDown, nfdata_.Ndown_, delayedDown_);
+            nfdata_.FVup_[ppUp] = fauxUp;
+            nfdata_.FVdown_[ppDown] = fauxDown;
+            dataCT_->vertices_.FlipAux(pp, ppUp, ppDown);
+            FlushIfFull();
+
+            AssertSizes();
         }
     }
 
+    void FlipAuxSpinPart(const size_t &pp, const double &alpha, NMatrix_t &Nspin, LinAlg::DelayedRankOneT<TNScalar_t> &delayed)
+    {
+        const size_t kk = Nspin.n_rows();
+        SiteVector_t col = upddata_.workspace_.vec1_.View(kk);
+        SiteVector_t row = upddata_.workspace_.vec2_.View(kk);
+        for (size_t ii = 0; ii < kk; ii++)
+        {
+            col(ii) = delayed.Element(Nspin, ii, pp);
+            row(ii) = delayed.Element(Nspin, pp, ii);
+        }
+        col(pp) += 1.0;
+
+        if (delayed.IsEnabled())
+        {
+            delayed.RankOneUpdate(Nspin, col, row, alpha);
+        }
+        else
+        {
+            LinAlg::RankOneUpdate(Nspin, col, row, alpha, upddata_.workspace_);
+        }
+    }
+
+    // Apply the pending delayed updates, so that Nup_ and Ndown_ are the true N matrices.
+    void FlushDelayed()
+    {
+        delayedUp_.Flush(nfdata_.Nup_);
+        delayedDown_.Flush(nfdata_.Ndown_);
+    }
+
+    void FlushIfFull()
+    {
+        if (delayedUp_.IsEnabled() && (delayedUp_.IsFull() || delayedDown_.IsFull()))
+        {
+            FlushDelayed();
+        }
+    }
+
+    // Keep track of log|det(N^-1)| and of the pivots of the accepted updates.
+    void AcceptRatio(const double &ratio)
+    {
+        logDeterminant_ += std::log(std::abs(ratio));
+        if (std::abs(ratio) < cleanUpdatePivot_)
+        {
+            needsCleanUpdate_ = true;
+        }
+    }
+
+    // Recompute the N matrices from scratch, in double, then store them in the precision of the fast updates.
     void CleanUpdate()
     {
+        FlushDelayed();
 
         const size_t kkup = dataCT_->vertices_.NUp();
         const size_t kkdown = dataCT_->vertices_.NDown();
+        Matrix_t &Nclean = nfdata_.dummy_;
+        logDeterminant_ = 0.0;
+        signDeterminant_ = 1;
+        cleanUpdateDrift_ = 0.0;
+        needsCleanUpdate_ = false;
 
         if (kkup != 0)
         {
-
-            for (size_t iUp = 0; iUp < kkup; iUp++)
+            Nclean.SetSize(kkup, kkup);
+            const VertexPartStore &partsUp = dataCT_->vertices_.parts(FermionSpin_t::Up);
+            for (size_t jUp = 0; jUp < kkup; jUp++)
             {
-                for (size_t jUp = 0; jUp < kkup; jUp++)
+                double *const colJ = Nclean.memptr() + jUp * Nclean.mem_n_rows();
+                GetGreenTau0RowCol(partsUp[jUp], nullptr, colJ);
+                const double fauxJm1 = nfdata_.FVup_[jUp] - 1.0;
+                for (size_t iUp = 0; iUp < kkup; iUp++)
                 {
-
-                    nfdata_.Nup_(iUp, jUp) =
-                        GetGreenTau0(dataCT_->vertices_.atUp(iUp), dataCT_->vertices_.atUp(jUp)) * (nfdata_.FVup_(jUp) - 1.0);
-
-                    if (iUp == jUp)
-                    {
-                        nfdata_.Nup_(iUp, iUp) -= nfdata_.FVup_(iUp);
-                    }
+                    colJ[iUp] *= fauxJm1;
                 }
+                Nclean(jUp, jUp) -= nfdata_.FVup_[jUp];
             }
-            nfdata_.Nup_.Inverse();
+            double signUp = 1.0;
+            logDeterminant_ += Nclean.LogAbsDeterminant(signUp);
+            signDeterminant_ *= (signUp < 0.0) ? -1 : 1;
+            Nclean.Inverse();
+            cleanUpdateDrift_ = std::max(cleanUpdateDrift_, Nclean.MaxAbsDiff(nfdata_.Nup_));
+            nfdata_.Nup_.CopyFrom(Nclean);
         }
 
         if (kkdown != 0)
         {
-            for (size_t iDown = 0; iDown < kkdown; iDown++)
+            Nclean.SetSize(kkdown, kkdown);
+            const VertexPartStore &partsDown = dataCT_->vertices_.parts(FermionSpin_t::Down);
+            for (size_t jDown = 0; jDown < kkdown; jDown++)
             {
-                for (size_t jDown = 0; jDown < kkdown; jDown++)
+                double *const colJ = Nclean.memptr() + jDown * Nclean.mem_n_rows();
+                GetGreenTau0RowCol(partsDown[jDown], nullptr, colJ);
+                const double fauxJm1 = nfdata_.FVdown_[jDown] - 1.0;
+                for (size_t iDown = 0; iDown < kkdown; iDown++)
                 {
-
-                    nfdata_.Ndown_(iDown, jDown) =
-                        GetGreenTau0(dataCT_->vertices_.atDown(iDown), dataCT_->vertices_.atDown(jDown)) * (nfdata_.FVdown_(jDown) - 1.0);
-
-                    if (iDown == jDown)
-                    {
-                        nfdata_.Ndown_(iDown, iDown) -= nfdata_.FVdown_(iDown);
-                    }
+                    colJ[iDown] *= fauxJm1;
                 }
+                Nclean(jDown, jDown) -= nfdata_.FVdown_[jDown];
             }
-            nfdata_.Ndown_.Inverse();
+            double signDown = 1.0;
+            logDeterminant_ += Nclean.LogAbsDeterminant(signDown);
+            signDeterminant_ *= (signDown < 0.0) ? -1 : 1;
+            Nclean.Inverse();
+            cleanUpdateDrift_ = std::max(cleanUpdateDrift_, Nclean.MaxAbsDiff(nfdata_.Ndown_));
+            nfdata_.Ndown_.CopyFrom(Nclean);
         }
     }
 
     double GetGreenTau0(const VertexPart &x, const VertexPart &y) const
     {
         assert(x.spin() == y.spin());
+        return GreenTau0(x.spin())(x.superSite(), y.superSite(), x.tau() - y.tau());
+    }
+
+    // row[i] = G0(x, x_i) and col[i] = G0(x_i, x) for all the current vertex parts x_i of the spin of x, in one call (see
+    // GreenCluster0Tau::EvaluateRowCol). row or col can be nullptr.
+    void GetGreenTau0RowCol(const VertexPart &x, double *row, double *col)
+    {
+        const VertexPartStore &parts = dataCT_->vertices_.parts(x.spin());
+        GreenTau0(x.spin()).EvaluateRowCol(x.superSite(), x.tau(), parts, parts.size(), upddata_.green0Scratch_, row, col);
+    }
+
+    const GreenTau_t &GreenTau0([[maybe_unused]] const FermionSpin_t &spin) const
+    {
 #ifndef AFM
-        return (dataCT_->green0CachedUp_(x.superSite(), y.superSite(), x.tau() - y.tau()));
+        return *dataCT_->green0CachedUp_;
 #else
-        if (x.spin() == FermionSpin_t::Up)
+        return (spin == FermionSpin_t::Up) ? *dataCT_->green0CachedUp_ : *dataCT_->green0CachedDown_;
+#endif
+    }
+
+    // Replica exchange (see MC::MonteCarloTempering). The configuration, as a flat vector to be sent to another replica:
+    // CONFIG_STRIDE numbers per vertex, its type, then the tau, site, spin, orbital and aux of its two parts.
+    std::vector<double> Configuration() const
+    {
+        std::vector<double> configuration;
+        configuration.reserve(CONFIG_STRIDE * dataCT_->vertices_.size());
+        for (size_t ii = 0; ii < dataCT_->vertices_.size(); ii++)
         {
-            return (dataCT_->green0CachedUp_(x.superSite(), y.superSite(), x.tau() - y.tau()));
+            AppendToConfiguration(dataCT_->vertices_.at(ii).vStart(), dataCT_->vertices_.at(ii).vEnd(), configuration);
         }
-        else
+        return configuration;
+    }
+
+    // Replace the configuration by the one of another replica. The replicas are not at the same U, so the weights of the
+    // vertices and the N matrices (G0 depends on U) are recomputed for this chain, by a clean update.
+    void SetConfiguration(const std::vector<double> &configuration)
+    {
+        assert(configuration.size() % CONFIG_STRIDE == 0);
+        FlushDelayed();
+        dataCT_->vertices_.Clear();
+        nfdata_.FVup_.clear();
+        nfdata_.FVdown_.clear();
+
+        Sign_t signProbProb = 1;
+        for (size_t ii = 0; ii < configuration.size(); ii += CONFIG_STRIDE)
         {
-            return (dataCT_->green0CachedDown_(x.superSite(), y.superSite(), x.tau() - y.tau()));
+            const auto vtype = static_cast<Diagrammatic::VertexType>(static_cast<int>(configuration[ii]));
+            const VertexPart x = ToVertexPart(vtype, configuration.data() + ii + 1);
+            const VertexPart y = ToVertexPart(vtype, configuration.data() + ii + 6);
+            const Vertex vertex(vtype, x, y, vertexBuilder_.GetProbProb(x, y));
+            if (vertex.probProb() < 0.0)
+            {
+                signProbProb *= -1;
+            }
+            dataCT_->vertices_.AppendVertex(vertex);
         }
-#endif
+
+        for (size_t iUp = 0; iUp < dataCT_->vertices_.NUp(); iUp++)
+        {
+            nfdata_.FVup_.push_back(Derived().FAux(dataCT_->vertices_.atUp(iUp)));
+        }
+        for (size_t iDown = 0; iDown < dataCT_->vertices_.NDown(); iDown++)
+        {
+            nfdata_.FVdown_.push_back(Derived().FAux(dataCT_->vertices_.atDown(iDown)));
+        }
+        nfdata_.Nup_.SetSize(dataCT_->vertices_.NUp(), dataCT_->vertices_.NUp());
+        nfdata_.Ndown_.SetSize(dataCT_->vertices_.NDown(), dataCT_->vertices_.NDown());
+
+        CleanUpdate();
+        cleanUpdateDrift_ = 0.0; // the N matrices before the clean update were not the ones of this configuration
+        dataCT_->sign_ = signProbProb * signDeterminant_;
+        AssertSizes();
+    }
+
+    // Full state of the chain, for the checkpoints (boost::serialization archives, see MC::Checkpoint): the configuration, the N
+    // matrices, the random engine, the accumulated measurements and the counters. The delayed updates are applied first.
+    template <class Archive> void SaveCheckpoint(Archive &ar)
+    {
+        FlushDelayed();
+        AssertSizes();
+        ar << dataCT_->vertices_ << dataCT_->sign_ << nfdata_.FVup_ << nfdata_.FVdown_;
+        nfdata_.Nup_.SaveCheckpoint(ar);
+        nfdata_.Ndown_.SaveCheckpoint(ar);
+        ar << logDeterminant_ << cleanUpdateDrift_ << needsCleanUpdate_ << updStats_ << updatesProposed_ << updsamespin_;
+        ar << Utilities::EngineState(rng_);
+        obs_.SaveCheckpoint(ar);
+    }
+
+    template <class Archive> void LoadCheckpoint(Archive &ar)
+    {
+        FlushDelayed();
+        ar >> dataCT_->vertices_ >> dataCT_->sign_ >> nfdata_.FVup_ >> nfdata_.FVdown_;
+        nfdata_.Nup_.LoadCheckpoint(ar);
+        nfdata_.Ndown_.LoadCheckpoint(ar);
+        ar >> logDeterminant_ >> cleanUpdateDrift_ >> needsCleanUpdate_ >> updStats_ >> updatesProposed_ >> updsamespin_;
+        std::string rngState;
+        ar >> rngState;
+        Utilities::SetEngineState(rng_, rngState);
+        obs_.LoadCheckpoint(ar);
+        AssertSizes();
+    }
+
+    void SaveConfiguration(const std::string &fname) const { dataCT_->vertices_.SaveConfig(fname); }
+
+    // The configuration for the next warm start: Config.dat (text) and Config.bin (see Diagrammatic::ConfigSnapshot).
+    void SaveConfigurationFiles() const
+    {
+        dataCT_->vertices_.SaveConfig("Config.dat");
+        Diagrammatic::ConfigSnapshot::Save("Config.bin", SnapshotHeader(), dataCT_->vertices_, isConfigCompressed_);
+    }
+
+    // Same as LoadConfiguration, from a binary snapshot (Config.bin). It must be of the same beta, Nc and NOrb; a snapshot of
+    // another model hash (ex: another U or mu) is loaded as the text files are.
+    bool LoadConfigurationSnapshot(const std::string &fname)
+    {
+        Diagrammatic::ConfigSnapshot::Header header;
+        std::vector<std::pair<VertexPart, VertexPart>> parts;
+        if (!Diagrammatic::ConfigSnapshot::Load(fname, header, parts))
+        {
+            return false;
+        }
+
+        const Diagrammatic::ConfigSnapshot::Header thisHeader = SnapshotHeader();
+        if ((std::abs(header.beta - thisHeader.beta) > 1e-10) || (header.Nc != thisHeader.Nc) || (header.NOrb != thisHeader.NOrb))
+        {
+            return false;
+        }
+        if (header.modelHash != thisHeader.modelHash)
+        {
+            Logging::Debug(fname + " is the configuration of another model.");
+        }
+
+        std::vector<double> configuration;
+        configuration.reserve(CONFIG_STRIDE * parts.size());
+        for (const auto &xy : parts)
+        {
+            for (const VertexPart &vp : {xy.first, xy.second})
+            {
+                if ((vp.site() >= header.Nc) || (vp.orbital() >= header.NOrb) || (vp.tau() < 0.0) || (vp.tau() > header.beta))
+                {
+                    return false;
+                }
+            }
+            AppendToConfiguration(xy.first, xy.second, configuration);
+        }
+
+        SetConfiguration(configuration);
+        return true;
+    }
+
+    // Warm start: load the configuration saved by SaveMeas (Config.dat, see Vertices::SaveConfig), N is rebuilt for the G0 of this
+    // chain. Returns false, and keeps the current configuration, if there is no such file or if it does not fit this model.
+    bool LoadConfiguration(const std::string &fname)
+    {
+        std::ifstream fin(fname);
+        if (!fin.good())
+        {
+            return false;
+        }
+
+        std::vector<double> configuration;
+        std::string line;
+        while (std::getline(fin, line))
+        {
+            std::istringstream iss(line);
+            const std::vector<double> cols{std::istream_iterator<double>(iss), std::istream_iterator<double>()};
+            if (cols.empty())
+            {
+                continue;
+            }
+            if ((cols.size() != 7) && (cols.size() != 9))
+            {
+                return false;
+            }
+
+            const double aux = cols[0];
+            const double site = cols[1];
+            const double tau = cols[2];
+            const double tauEnd = (cols.size() == 9) ? cols[7] : tau;
+            const double spinStart = cols[3];
+            const double spinEnd = cols[4];
+            const double orbitalStart = cols[5];
+            const double orbitalEnd = cols[6];
+            if ((site >= modelPtr_->Nc()) || (std::max(orbitalStart, orbitalEnd) >= dataCT_->NOrb_) || (std::min(tau, tauEnd) < 0.0) ||
+                (std::max(tau, tauEnd) > beta()))
+            {
+                return false;
+            }
+
+            // The older files do not have the vertex type, but without phonons it is given by the spins and the orbitals.
+            Diagrammatic::VertexType vtype = Diagrammatic::VertexType::HubbardInterSpin;
+            if (cols.size() == 9)
+            {
+                vtype = static_cast<Diagrammatic::VertexType>(static_cast<int>(cols[8]));
+            }
+            else if (spinStart != spinEnd)
+            {
+                vtype = (orbitalStart == orbitalEnd) ? Diagrammatic::VertexType::HubbardIntra : Diagrammatic::VertexType::HubbardInter;
+            }
+
+            configuration.insert(configuration.end(), {static_cast<double>(static_cast<int>(vtype)), tau, site, spinStart, orbitalStart,
+                                                       aux, tauEnd, site, spinEnd, orbitalEnd, aux});
+        }
+
+        SetConfiguration(configuration);
+        return true;
+    }
+
+    // log|W(C)| of the current configuration for this chain, without the 1/k! and the constant factors that are the same for all
+    // the replicas. Exact right after a CleanUpdate.
+    double LogWeight() const
+    {
+        double logWeight = logDeterminant_;
+        for (size_t ii = 0; ii < dataCT_->vertices_.size(); ii++)
+        {
+            logWeight += std::log(std::abs(dataCT_->vertices_.at(ii).probProb()));
+        }
+        return logWeight;
     }
 
     void Measure()
     {
         AssertSizes();
+        FlushDelayed();
 #ifdef SLMC
         configParser_.SaveConfig(dataCT_->vertices_, logDeterminant_, dataCT_->sign_);
 #else
-        const SiteVector_t FVupM1 = (nfdata_.FVup_ - 1.0);
-        const SiteVector_t FVdownM1 = (nfdata_.FVdown_ - 1.0);
+        const SiteVector_t FVupM1 = (SiteVector_t(nfdata_.FVup_) - 1.0);
+        const SiteVector_t FVdownM1 = (SiteVector_t(nfdata_.FVdown_) - 1.0);
         DDMGMM(FVupM1, nfdata_.Nup_, *(dataCT_->MupPtr_));
         DDMGMM(FVdownM1, nfdata_.Ndown_, *(dataCT_->MdownPtr_));
         obs_.Measure();
@@ -595,13 +1028,48 @@ class ABC_MarkovChain
         SaveUpd("Measurements");
         if (mpiUt::Tools::Rank() == mpiUt::Tools::master)
         {
-            dataCT_->vertices_.SaveConfig("Config.dat");
+            SaveConfigurationFiles();
         }
 
         Logging::Info("Finished Saving MarkovChain.");
 #endif
     }
 
+    // Same as SaveMeas, for the chains running on the threads of this process. Must be called from one thread only.
+    static void SaveMeas(const std::vector<ABC_MarkovChain *> &chains)
+    {
+        assert(!chains.empty());
+#ifdef SLMC
+        for (ABC_MarkovChain *chain : chains)
+        {
+            chain->SaveMeas();
+        }
+#else
+        std::vector<Result::ISResult> isResultVec;
+        std::vector<UpdStats_t> updStatsVec;
+        for (ABC_MarkovChain *chain : chains)
+        {
+            isResultVec.push_back(chain->obs_.GetISResult());
+            updStatsVec.push_back(chain->updStats_);
+        }
+        chains.at(0)->obs_.SaveISResults(isResultVec);
+        SaveUpdStats("Measurements", updStatsVec);
+        if (mpiUt::Tools::Rank() == mpiUt::Tools::master)
+        {
+            chains.at(0)->SaveConfigurationFiles();
+        }
+
+        Logging::Info("Finished Saving MarkovChains.");
+#endif
+    }
+
+    // Save of a replica of the replica exchange that did not measure, it only takes part in the gathers of the results.
+    void SaveMeasNoResult()
+    {
+        obs_.SaveISResults({});
+        SaveUpd("Measurements");
+    }
+
     void SaveTherm()
     {
 
@@ -612,54 +1080,95 @@ class ABC_MarkovChain
         }
     }
 
-    void SaveUpd(const std::string &updType)
+    static void SaveTherm(const std::vector<ABC_MarkovChain *> &chains)
     {
         std::vector<UpdStats_t> updStatsVec;
-#ifdef HAVEMPI
-
-        mpi::communicator world;
-        if (mpiUt::Tools::Rank() == mpiUt::Tools::master)
-        {
-            mpi::gather(world, updStats_, updStatsVec, mpiUt::Tools::master);
-        }
-        else
+        for (ABC_MarkovChain *chain : chains)
         {
-            mpi::gather(world, updStats_, mpiUt::Tools::master);
+            updStatsVec.push_back(chain->updStats_);
+            for (auto &updStat : chain->updStats_)
+            {
+                updStat.second = 0;
+            }
         }
+        SaveUpdStats("Thermalization", updStatsVec);
+    }
+
+    void SaveUpd(const std::string &updType) { SaveUpdStats(updType, {updStats_}); }
+
+    // Log the update statistics of the given chains of this process, and of all the other processes.
+    static void SaveUpdStats(const std::string &updType, const std::vector<UpdStats_t> &updStatsVecLocal)
+    {
+        const std::vector<UpdStats_t> updStatsVec = mpiUt::Tools::GatherUpdStats(updStatsVecLocal);
         if (mpiUt::Tools::Rank() == mpiUt::Tools::master)
         {
             Logging::Info("\n\n Statistics Updates of " + updType + ":\n" + mpiUt::Tools::SaveUpdStats(updStatsVec) + "\n\n");
         }
+    }
 
-#else
-        updStatsVec.push_back(updStats_);
-        Logging::Info("\n\n Statistics Updates of " + updType + ":\n" + mpiUt::Tools::SaveUpdStats(updStatsVec) + "\n\n");
+  protected:
+    static const size_t CONFIG_STRIDE = 11; // numbers per vertex in Configuration()
 
-#endif
+    static void AppendToConfiguration(const VertexPart &x, const VertexPart &y, std::vector<double> &configuration)
+    {
+        configuration.push_back(static_cast<int>(x.vtype()));
+        for (const VertexPart &vp : {x, y})
+        {
+            configuration.push_back(vp.tau());
+            configuration.push_back(static_cast<double>(vp.site()));
+            configuration.push_back(static_cast<int>(vp.spin()));
+            configuration.push_back(static_cast<double>(vp.orbital()));
+            configuration.push_back(static_cast<int>(vp.aux()));
+        }
+    }
+
+    Diagrammatic::ConfigSnapshot::Header SnapshotHeader() const
+    {
+        Diagrammatic::ConfigSnapshot::Header header;
+        header.modelHash = modelHash_;
+        header.beta = beta();
+        header.Nc = modelPtr_->Nc();
+        header.NOrb = dataCT_->NOrb_;
+        return header;
+    }
+
+    static VertexPart ToVertexPart(const Diagrammatic::VertexType &vtype, const double *data)
+    {
+        return VertexPart(vtype, data[0], static_cast<Site_t>(data[1]), static_cast<FermionSpin_t>(static_cast<int>(data[2])),
+                          static_cast<Orbital_t>(data[3]), static_cast<AuxSpin_t>(static_cast<int>(data[4])));
     }
 
-  protected:
     // attributes
     std::shared_ptr<Model_t> modelPtr_;
     Utilities::EngineTypeMt19937_t rng_;
     Utilities::UniformRngMt19937_t urng_;
-    NFData nfdata_;
-    UpdData upddata_;
+    NFData<TNScalar_t> nfdata_;
+    UpdData<TNScalar_t> upddata_;
     std::shared_ptr<Obs::ISDataCT> dataCT_;
     Obs::Observables obs_;
     Diagrammatic::VertexBuilder vertexBuilder_;
 
 #ifdef SLMC
     Diagrammatic::ConfigParser configParser_;
-    double logDeterminant_;
-
 #endif
+    double logDeterminant_; // log|det(Nup^-1)| + log|det(Ndown^-1)|, exact after each CleanUpdate
+    Sign_t signDeterminant_{1}; // sign of det(Nup^-1) det(Ndown^-1), set by each CleanUpdate
+    double cleanUpdateDrift_{0.0};
+    bool needsCleanUpdate_{false};
     UpdStats_t updStats_; //[0] = number of propsed, [1]=number of accepted
 
     size_t updatesProposed_;
     size_t updsamespin_;
 
     const bool isOneOrbitalOptimized_;
+
+    LinAlg::DelayedRankOneT<TNScalar_t> delayedUp_;
+    LinAlg::DelayedRankOneT<TNScalar_t> delayedDown_;
+
+    const double probFlip_; // probability to propose an aux spin flip instead of an insertion or removal
+    const double cleanUpdatePivot_;
+    const UInt64_t modelHash_;      // of the "model" block, in the header of Config.bin
+    const bool isConfigCompressed_; // Config.bin compressed with snappy
 }; // namespace Markov
 
 } // namespace Markov
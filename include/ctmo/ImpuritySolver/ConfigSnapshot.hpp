@@ -0,0 +1,227 @@
+#pragma once
+
+#include "ctmo/ImpuritySolver/VerticesSimple.hpp"
+
+#include <snappy.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+namespace Diagrammatic
+{
+
+// Binary snapshot of a configuration (Config.bin, written next to Config.dat), for the warm starts and the offline analysis. A few
+// kilobytes per thousand vertices, saved and loaded without parsing text. Layout, in the byte order of the machine that wrote it:
+//   header:  MAGIC (8 bytes), version u32, flags u32 (bit 0: the records are compressed with snappy), modelHash u64, beta f64,
+//            Nc u64, NOrb u64, number of vertices u64, size of the records in bytes u64
+//   records: one per vertex, RECORD_SIZE bytes: tauStart f64, tauEnd f64, site u32, orbitalStart u16, orbitalEnd u16,
+//            vtype u8, aux u8, spinStart u8, spinEnd u8
+// The model hash is the one of the "model" block of the parameters (see Hash), to recognize the snapshots of a model offline.
+class ConfigSnapshot
+{
+  public:
+    struct Header
+    {
+        UInt64_t modelHash{0};
+        double beta{0.0};
+        size_t Nc{0};
+        size_t NOrb{0};
+    };
+
+    static UInt64_t Hash(const std::string &str) { return Utilities::HashBytes(str.data(), str.size()); }
+
+    static void Write(std::ostream &out, const Header &header, const Vertices &vertices, const bool &isCompressed)
+    {
+        std::string records(RECORD_SIZE * vertices.size(), '\0');
+        char *record = &records[0];
+        for (size_t ii = 0; ii < vertices.size(); ii++, record += RECORD_SIZE)
+        {
+            const VertexPart &x = vertices.at(ii).vStart();
+            const VertexPart &y = vertices.at(ii).vEnd();
+            assert(x.site() == y.site());
+            char *pos = record;
+            Pack<double>(pos, x.tau());
+            Pack<double>(pos, y.tau());
+            Pack<std::uint32_t>(pos, x.site());
+            Pack<std::uint16_t>(pos, x.orbital());
+            Pack<std::uint16_t>(pos, y.orbital());
+            Pack<std::uint8_t>(pos, static_cast<int>(x.vtype()));
+            Pack<std::uint8_t>(pos, static_cast<int>(x.aux()));
+            Pack<std::uint8_t>(pos, static_cast<int>(x.spin()));
+            Pack<std::uint8_t>(pos, static_cast<int>(y.spin()));
+        }
+
+        if (isCompressed)
+        {
+            std::string compressed;
+            snappy::Compress(records.data(), records.size(), &compressed);
+            records.swap(compressed);
+        }
+
+        std::string head(HEADER_SIZE, '\0');
+        char *pos = &head[0];
+        std::memcpy(pos, MAGIC, sizeof(MAGIC));
+        pos += sizeof(MAGIC);
+        Pack<std::uint32_t>(pos, VERSION);
+        Pack<std::uint32_t>(pos, isCompressed ? FLAG_SNAPPY : 0);
+        Pack<std::uint64_t>(pos, header.modelHash);
+        Pack<double>(pos, header.beta);
+        Pack<std::uint64_t>(pos, header.Nc);
+        Pack<std::uint64_t>(pos, header.NOrb);
+        Pack<std::uint64_t>(pos, vertices.size());
+        Pack<std::uint64_t>(pos, records.size());
+
+        out.write(head.data(), static_cast<std::streamsize>(head.size()));
+        out.write(records.data(), static_cast<std::streamsize>(records.size()));
+    }
+
+    // Reads a snapshot written by Write. The vertices are given as the pairs (vStart, vEnd), their weights depend on the model of
+    // the reader. Returns false if the input is not a complete and valid snapshot of this version: the sizes of the header are
+    // checked against the bytes left in the input before anything is allocated, and the enums against their ranges.
+    static bool Read(std::istream &in, Header &header, std::vector<std::pair<VertexPart, VertexPart>> &parts)
+    {
+        std::string head(HEADER_SIZE, '\0');
+        if (!in.read(&head[0], static_cast<std::streamsize>(head.size())) || (std::memcmp(head.data(), MAGIC, sizeof(MAGIC)) != 0))
+        {
+            return false;
+        }
+
+        const char *pos = head.data() + sizeof(MAGIC);
+        const auto version = Unpack<std::uint32_t>(pos);
+        const auto flags = Unpack<std::uint32_t>(pos);
+        header.modelHash = Unpack<std::uint64_t>(pos);
+        header.beta = Unpack<double>(pos);
+        header.Nc = Unpack<std::uint64_t>(pos);
+        header.NOrb = Unpack<std::uint64_t>(pos);
+        const auto nVertices = Unpack<std::uint64_t>(pos);
+        const auto recordsSize = Unpack<std::uint64_t>(pos);
+        const bool isCompressed = ((flags & FLAG_SNAPPY) != 0);
+        if ((version != VERSION) || (recordsSize > RemainingSize(in)) || (!isCompressed && !IsRecordsSize(recordsSize, nVertices)))
+        {
+            return false;
+        }
+
+        std::string records(recordsSize, '\0');
+        if (!in.read(&records[0], static_cast<std::streamsize>(records.size())))
+        {
+            return false;
+        }
+        if (isCompressed)
+        {
+            size_t uncompressedSize = 0;
+            if (!snappy::GetUncompressedLength(records.data(), records.size(), &uncompressedSize) ||
+                !IsRecordsSize(uncompressedSize, nVertices))
+            {
+                return false;
+            }
+            std::string uncompressed;
+            if (!snappy::Uncompress(records.data(), records.size(), &uncompressed))
+            {
+                return false;
+            }
+            records.swap(uncompressed);
+        }
+        if (!IsRecordsSize(records.size(), nVertices))
+        {
+            return false;
+        }
+
+        parts.clear();
+        parts.reserve(nVertices);
+        for (const char *record = records.data(); record != records.data() + records.size(); record += RECORD_SIZE)
+        {
+            pos = record;
+            const auto tauStart = Unpack<double>(pos);
+            const auto tauEnd = Unpack<double>(pos);
+            const Site_t site = Unpack<std::uint32_t>(pos);
+            const Orbital_t orbitalStart = Unpack<std::uint16_t>(pos);
+            const Orbital_t orbitalEnd = Unpack<std::uint16_t>(pos);
+            const auto vtypeByte = Unpack<std::uint8_t>(pos);
+            const auto auxByte = Unpack<std::uint8_t>(pos);
+            const auto spinStartByte = Unpack<std::uint8_t>(pos);
+            const auto spinEndByte = Unpack<std::uint8_t>(pos);
+            if ((vtypeByte >= static_cast<int>(VertexType::Invalid)) || (auxByte > static_cast<int>(AuxSpin_t::Zero)) ||
+                (spinStartByte > static_cast<int>(FermionSpin_t::Down)) || (spinEndByte > static_cast<int>(FermionSpin_t::Down)))
+            {
+                parts.clear();
+                return false;
+            }
+            const auto vtype = static_cast<VertexType>(vtypeByte);
+            const auto aux = static_cast<AuxSpin_t>(auxByte);
+            const auto spinStart = static_cast<FermionSpin_t>(spinStartByte);
+            const auto spinEnd = static_cast<FermionSpin_t>(spinEndByte);
+            parts.emplace_back(VertexPart(vtype, tauStart, site, spinStart, orbitalStart, aux),
+                               VertexPart(vtype, tauEnd, site, spinEnd, orbitalEnd, aux));
+        }
+        return true;
+    }
+
+    // Written under another name, then renamed, so that a crash never leaves a partial snapshot for the next warm start.
+    static void Save(const std::string &fname, const Header &header, const Vertices &vertices, const bool &isCompressed)
+    {
+        const std::string fnameTmp = fname + ".tmp";
+        {
+            std::ofstream fout(fnameTmp, std::ios::binary);
+            Write(fout, header, vertices, isCompressed);
+            fout.flush();
+            if (!fout.good())
+            {
+                Logging::Warn("Could not write the configuration snapshot " + fnameTmp + ".");
+                fout.close();
+                std::remove(fnameTmp.c_str());
+                return;
+            }
+        }
+        std::rename(fnameTmp.c_str(), fname.c_str());
+    }
+
+    static bool Load(const std::string &fname, Header &header, std::vector<std::pair<VertexPart, VertexPart>> &parts)
+    {
+        std::ifstream fin(fname, std::ios::binary);
+        return fin.good() && Read(fin, header, parts);
+    }
+
+  private:
+    // The bytes left to read in the input, 0 if it can not seek.
+    static std::uint64_t RemainingSize(std::istream &in)
+    {
+        const std::istream::pos_type start = in.tellg();
+        if ((start == std::istream::pos_type(-1)) || !in.seekg(0, std::ios::end))
+        {
+            in.clear();
+            return 0;
+        }
+        const std::istream::pos_type end = in.tellg();
+        in.seekg(start);
+        return (end == std::istream::pos_type(-1) || end < start) ? 0 : static_cast<std::uint64_t>(end - start);
+    }
+
+    // Without overflow for the nVertices of a corrupted header.
+    static bool IsRecordsSize(const std::uint64_t &size, const std::uint64_t &nVertices)
+    {
+        return (size % RECORD_SIZE == 0) && (size / RECORD_SIZE == nVertices);
+    }
+
+    template <typename T, typename S> static void Pack(char *&pos, const S &value)
+    {
+        const T packed = static_cast<T>(value);
+        std::memcpy(pos, &packed, sizeof(T));
+        pos += sizeof(T);
+    }
+
+    template <typename T> static T Unpack(const char *&pos)
+    {
+        T value;
+        std::memcpy(&value, pos, sizeof(T));
+        pos += sizeof(T);
+        return value;
+    }
+
+    static constexpr char MAGIC[8] = {'C', 'T', 'M', 'O', 'C', 'F', 'G', '\0'};
+    static constexpr std::uint32_t VERSION = 1;
+    static constexpr std::uint32_t FLAG_SNAPPY = 1;
+    static constexpr size_t HEADER_SIZE = sizeof(MAGIC) + 2 * sizeof(std::uint32_t) + 6 * sizeof(std::uint64_t);
+    static constexpr size_t RECORD_SIZE = 2 * sizeof(double) + sizeof(std::uint32_t) + 2 * sizeof(std::uint16_t) + 4 * sizeof(std::uint8_t);
+};
+
+} // namespace Diagrammatic
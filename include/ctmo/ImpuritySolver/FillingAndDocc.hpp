@@ -40,7 +40,7 @@ class FillingAndDocc
     std::valarray<double> fillingUpCurrent() const { return fillingUpCurrent_; }
     std::map<std::string, double> GetObs() const { return obsmap_; }
 
-    double fillingUpTotalCurrent()
+    double fillingUpTotalCurrent() const
     {
         double fillingUpTotalCurrent = 0.0;
 
@@ -60,7 +60,7 @@ class FillingAndDocc
         return fillingUpTotalCurrent;
     }
 
-    double fillingDownTotalCurrent()
+    double fillingDownTotalCurrent() const
     {
         double fillingDownTotalCurrent = 0.0;
         size_t index = 0;
@@ -79,7 +79,7 @@ class FillingAndDocc
         return fillingDownTotalCurrent;
     }
 
-    double doccTotalCurrent()
+    double doccTotalCurrent() const
     {
         double doccTotalCurrent = 0.0;
         size_t index = 0;
@@ -140,27 +140,15 @@ class FillingAndDocc
                     const Site_t siteRng = ioModelPtr_->FindSitesRng(s1, s1, (*urngPtr_)()).first;
                     const SuperSite_t superSiteRng{siteRng, oIndex};
 
-                    for (size_t iUp = 0; iUp < KKUp; iUp++)
-                    {
-                        const SuperSite_t superSite = dataCT_->vertices_.atUp(iUp).superSite();
-                        const Tau_t tt = dataCT_->vertices_.atUp(iUp).tau();
-
-                        vec1Up(iUp) = dataCT_->green0CachedUp_(superSiteRng, superSite, tauRng - tt);
-                        vec2Up(iUp) = dataCT_->green0CachedUp_(superSite, superSiteRng, tt - tauRng);
-                    }
-
-                    for (size_t iDown = 0; iDown < KKDown; iDown++)
-                    {
-                        const SuperSite_t superSite = dataCT_->vertices_.atDown(iDown).superSite();
-                        const Tau_t tt = dataCT_->vertices_.atDown(iDown).tau();
+                    dataCT_->green0CachedUp_->EvaluateRowCol(superSiteRng, tauRng, dataCT_->vertices_.parts(FermionSpin_t::Up), KKUp,
+                                                             green0Scratch_, vec1Up.memptr(), vec2Up.memptr());
 #ifdef AFM
-                        vec1Down(iDown) = dataCT_->green0CachedDown_(superSiteRng, superSite, tauRng - tt);
-                        vec2Down(iDown) = dataCT_->green0CachedDown_(superSite, superSiteRng, tt - tauRng);
+                    dataCT_->green0CachedDown_->EvaluateRowCol(superSiteRng, tauRng, dataCT_->vertices_.parts(FermionSpin_t::Down), KKDown,
+                                                               green0Scratch_, vec1Down.memptr(), vec2Down.memptr());
 #else
-                        vec1Down(iDown) = dataCT_->green0CachedUp_(superSiteRng, superSite, tauRng - tt);
-                        vec2Down(iDown) = dataCT_->green0CachedUp_(superSite, superSiteRng, tt - tauRng);
+                    dataCT_->green0CachedUp_->EvaluateRowCol(superSiteRng, tauRng, dataCT_->vertices_.parts(FermionSpin_t::Down), KKDown,
+                                                             green0Scratch_, vec1Down.memptr(), vec2Down.memptr());
 #endif
-                    }
 
                     double dotup = 0.0;
                     double dotdown = 0.0;
@@ -171,12 +159,12 @@ class FillingAndDocc
                         dotdown = LinAlg::Dot(vec1Down, *(dataCT_->MdownPtr_), vec2Down);
                     }
 
-                    const double green00Up = dataCT_->green0CachedUp_(superSite1, superSite1, -eps);
+                    const double green00Up = (*dataCT_->green0CachedUp_)(superSite1, superSite1, -eps);
 
 #ifdef AFM
-                    const double green00Down = dataCT_->green0CachedDown_(superSite1, superSite1, -eps);
+                    const double green00Down = (*dataCT_->green0CachedDown_)(superSite1, superSite1, -eps);
 #else
-                    const double green00Down = dataCT_->green0CachedUp_(superSite1, superSite1, -eps);
+                    const double green00Down = (*dataCT_->green0CachedUp_)(superSite1, superSite1, -eps);
 #endif
                     const double nUptmp = green00Up - dotup;
                     const double nDowntmp = green00Down - dotdown;
@@ -246,10 +234,20 @@ class FillingAndDocc
         obsmap_["Sz"] = SzTotal;
     }
 
+    // The accumulated values, for the checkpoints (boost::serialization).
+    template <class Archive> void serialize(Archive &ar, const unsigned int /*version*/)
+    {
+        ar &fillingUp_;
+        ar &fillingDown_;
+        ar &docc_;
+        ar &Sz_;
+    }
+
   private:
     std::shared_ptr<ISDataCT> dataCT_;
     std::shared_ptr<IOModel_t> ioModelPtr_;
     std::shared_ptr<Utilities::UniformRngFibonacci3217_t> urngPtr_;
+    GreenTau::BatchScratch green0Scratch_;
 
     std::map<std::string, double> obsmap_;
 
@@ -3,12 +3,15 @@
 #include "ctmo/Foundations/LinAlg.hpp"
 #include "ctmo/ImpuritySolver/ISData.hpp"
 #include "ctmo/Foundations/UtilitiesRandom.hpp"
+#include <array>
+#include <thread>
 
 namespace Markov
 {
 namespace Obs
 {
 const size_t N_BIN_TAU = 100000;
+const size_t N_MOMENTS = 4;
 using IOModel_t = IO::Base_IOModel;
 using Model_t = Models::ABC_Model_2D;
 
@@ -19,65 +22,67 @@ class GreenBinning
     GreenBinning(std::shared_ptr<ISDataCT> dataCT, const Json &jjSim, const FermionSpin_t &spin)
         : dataCT_(std::move(dataCT)), modelPtr_(dataCT_->modelPtr_), ioModelPtr_(modelPtr_->ioModelPtr()),
           NMat_(static_cast<size_t>(0.5 * (jjSim["solver"]["eCutGreen"].get<double>() * dataCT_->beta() / M_PI - 1.0))), spin_(spin),
-          NOrb_(jjSim["model"]["nOrb"].get<size_t>())
+          NOrb_(jjSim["model"]["nOrb"].get<size_t>()), nThreads_(jjSim["solver"].value("nThreads", size_t(1)))
     {
 
-        const size_t LL = ioModelPtr_->GetNIndepSuperSites(NOrb_);
-        M0Bins_.resize(LL);
-        M1Bins_.resize(LL);
-        M2Bins_.resize(LL);
-        M3Bins_.resize(LL);
-
-        for (size_t ii = 0; ii < M0Bins_.size(); ++ii)
-        {
-            M0Bins_.at(ii).resize(N_BIN_TAU, 0.0);
-            M1Bins_.at(ii).resize(N_BIN_TAU, 0.0);
-            M2Bins_.at(ii).resize(N_BIN_TAU, 0.0);
-            M3Bins_.at(ii).resize(N_BIN_TAU, 0.0);
-        }
+        bins_.resize(ioModelPtr_->GetNIndepSuperSites(NOrb_) * N_MOMENTS * N_BIN_TAU, 0.0);
+        BuildPairOffsets();
 
         Logging::Trace("GreenBinning Created.");
     }
 
     ClusterCubeCD_t greenCube() const { return greenCube_; };
 
+    // One column p2 of M at a time (contiguous in memory): the bins and the factors of the kkSpin contributions are computed first,
+    // in a loop without branches the compiler can vectorize, then the 4 moments are added, side by side in the bin.
     void MeasureGreenBinning(const Matrix<double> &Mmat)
     {
+        const std::vector<SuperSite_t> &superSites = dataCT_->vertices_.parts(spin_).superSites();
+        const std::vector<Tau_t> &taus = dataCT_->vertices_.parts(spin_).taus();
+        const size_t kkSpin = taus.size();
+        const double beta = dataCT_->beta_;
+        const double DeltaInv = N_BIN_TAU / beta;
+        const double sign = static_cast<double>(dataCT_->sign_);
+
+        Reserve(kkSpin);
+        size_t *const rowIndices = rowIndices_.data();
+        size_t *const binOffsets = binOffsets_.data();
+        double *const values = values_.data();
+        double *const dTaus = dTaus_.data();
+        for (size_t p1 = 0; p1 < kkSpin; ++p1)
+        {
+            rowIndices[p1] = SuperSiteIndex(superSites[p1]) * nSuperSites_;
+        }
 
-        const size_t kkSpin = (spin_ == FermionSpin_t::Up) ? dataCT_->vertices_.NUp() : dataCT_->vertices_.NDown();
-        const double DeltaInv = N_BIN_TAU / dataCT_->beta_;
-        if (static_cast<bool>(kkSpin))
+        for (size_t p2 = 0; p2 < kkSpin; ++p2)
         {
+            const double *const Mcol = Mmat.memptr() + p2 * Mmat.mem_n_rows();
+            const double tau2 = taus[p2];
+            const size_t colIndex = SuperSiteIndex(superSites[p2]);
+
             for (size_t p1 = 0; p1 < kkSpin; ++p1)
             {
-                for (size_t p2 = 0; p2 < kkSpin; ++p2)
-                {
-                    const SuperSite_t s1 =
-                        (spin_ == FermionSpin_t::Up) ? dataCT_->vertices_.atUp(p1).superSite() : dataCT_->vertices_.atDown(p1).superSite();
-                    const SuperSite_t s2 =
-                        (spin_ == FermionSpin_t::Up) ? dataCT_->vertices_.atUp(p2).superSite() : dataCT_->vertices_.atDown(p2).superSite();
-                    const size_t ll = ioModelPtr_->FindIndepSuperSiteIndex(s1, s2, NOrb_);
-                    double temp = static_cast<double>(dataCT_->sign_) * Mmat(p1, p2);
-
-                    double tau = (spin_ == FermionSpin_t::Up) ? dataCT_->vertices_.atUp(p1).tau() - dataCT_->vertices_.atUp(p2).tau()
-                                                              : dataCT_->vertices_.atDown(p1).tau() - dataCT_->vertices_.atDown(p2).tau();
-                    if (tau < 0.0)
-                    {
-                        temp *= -1.0;
-                        tau += dataCT_->beta_;
-                    }
-
-                    const int index = static_cast<int>(DeltaInv * tau);
-                    const double dTau = tau - (static_cast<double>(index) + 0.5) / DeltaInv;
+                double tau = taus[p1] - tau2;
+                const bool isNegative = (tau < 0.0);
+                tau += isNegative ? beta : 0.0;
+                const size_t index = std::min(static_cast<size_t>(DeltaInv * tau), N_BIN_TAU - 1);
+                binOffsets[p1] = pairOffsets_[rowIndices[p1] + colIndex] + N_MOMENTS * index;
+                values[p1] = (isNegative ? -sign : sign) * Mcol[p1];
+                dTaus[p1] = tau - (static_cast<double>(index) + 0.5) / DeltaInv;
+            }
 
-                    M0Bins_.at(ll).at(index) += temp;
-                    temp *= dTau;
-                    M1Bins_[ll][index] += temp;
-                    temp *= dTau;
-                    M2Bins_[ll][index] += temp;
-                    temp *= dTau;
-                    M3Bins_[ll][index] += temp;
-                }
+            for (size_t p1 = 0; p1 < kkSpin; ++p1)
+            {
+                double *const bin = bins_.data() + binOffsets[p1];
+                const double dTau = dTaus[p1];
+                double temp = values[p1];
+                bin[0] += temp;
+                temp *= dTau;
+                bin[1] += temp;
+                temp *= dTau;
+                bin[2] += temp;
+                temp *= dTau;
+                bin[3] += temp;
             }
         }
     }
@@ -93,33 +98,24 @@ class GreenBinning
         ClusterCubeCD_t greenCube(NOrb_ * ioModelPtr_->Nc, NOrb_ * ioModelPtr_->Nc, NMat_);
         greenCube.zeros();
 
+        const std::vector<BinSums_t> binSums = BinSumsThreads();
         for (size_t n = 0; n < NMat_; ++n)
         {
             const double omega_n = M_PI * (2.0 * n + 1.0) / dataCT_->beta_;
             const cd_t iomega_n(0.0, omega_n);
-            const cd_t fact = std::exp(iomega_n * dTau);
             const double lambda =
                 2.0 * std::sin(omega_n * dTau / 2.0) / (dTau * omega_n * (1.0 - omega_n * omega_n * dTau * dTau / 24.0) * NMeas);
 
             for (size_t ll = 0; ll < ioModelPtr_->GetNIndepSuperSites(NOrb_); ++ll)
             {
-                cd_t temp_matsubara = 0.0;
+                const BinSums_t &sums = binSums.at(ll);
+                const cd_t temp_matsubara = sums[0](n) + sums[1](n) * iomega_n + sums[2](n) * iomega_n * iomega_n / 2.0 +
+                                            sums[3](n) * iomega_n * iomega_n * iomega_n / 6.0;
 
                 const size_t llSite = ll % ioModelPtr_->indepSites().size(); // ll / ioModelPtr_->indepSites().size();
-                cd_t exp_factor = std::exp(iomega_n * dTau / 2.0) /
-                                  (static_cast<double>(ioModelPtr_->nOfAssociatedSites().at(llSite))); // watch out important factor!
-                for (size_t ii = 0; ii < N_BIN_TAU; ii++)
-                {
-                    cd_t coeff = lambda * exp_factor;
-
-                    temp_matsubara += coeff * M0Bins_.at(ll).at(ii);
-                    temp_matsubara += coeff * M1Bins_[ll][ii] * iomega_n;
-                    temp_matsubara += coeff * M2Bins_[ll][ii] * iomega_n * iomega_n / 2.0;
-                    temp_matsubara += coeff * M3Bins_[ll][ii] * iomega_n * iomega_n * iomega_n / 6.0;
-
-                    exp_factor *= fact;
-                }
-                indep_M_matsubara_sampled(ll) = temp_matsubara;
+                const cd_t exp_factor = std::exp(iomega_n * dTau / 2.0) /
+                                        (static_cast<double>(ioModelPtr_->nOfAssociatedSites().at(llSite))); // watch out important factor!
+                indep_M_matsubara_sampled(ll) = lambda * exp_factor * temp_matsubara;
             }
             const ClusterMatrixCD_t dummy1 = ioModelPtr_->IndepToFull(indep_M_matsubara_sampled, NOrb_);
             const ClusterMatrixCD_t &green0 = green0CubeMatsubara.slice(n);
@@ -133,21 +129,150 @@ class GreenBinning
         return greenCube; // the  measured interacting green function
     }
 
+    // The accumulated bins, for the checkpoints (boost::serialization).
+    template <class Archive> void serialize(Archive &ar, const unsigned int /*version*/)
+    {
+        ar &bins_;
+    }
+
   private:
+    using BinSums_t = std::array<arma::cx_vec, 4>;
+
+    // Index of the super site (site, orbital) in pairOffsets_.
+    size_t SuperSiteIndex(const SuperSite_t &s) const
+    {
+        assert((s.first < ioModelPtr_->Nc) && (s.second < NOrb_));
+        return s.first + ioModelPtr_->Nc * s.second;
+    }
+
+    // The offset in bins_ of each pair of super sites, so that a measurement does not go through FindIndepSuperSiteIndex.
+    void BuildPairOffsets()
+    {
+        const size_t Nc = ioModelPtr_->Nc;
+        nSuperSites_ = Nc * NOrb_;
+        pairOffsets_.resize(nSuperSites_ * nSuperSites_);
+        for (size_t o1 = 0; o1 < NOrb_; o1++)
+        {
+            for (size_t s1 = 0; s1 < Nc; s1++)
+            {
+                for (size_t o2 = 0; o2 < NOrb_; o2++)
+                {
+                    for (size_t s2 = 0; s2 < Nc; s2++)
+                    {
+                        const size_t ll = ioModelPtr_->FindIndepSuperSiteIndex({s1, o1}, {s2, o2}, NOrb_);
+                        pairOffsets_.at(SuperSiteIndex({s1, o1}) * nSuperSites_ + SuperSiteIndex({s2, o2})) = ll * N_MOMENTS * N_BIN_TAU;
+                    }
+                }
+            }
+        }
+    }
+
+    // Scratch of MeasureGreenBinning, grown with some margin so that the measurements do not allocate.
+    void Reserve(const size_t &kk)
+    {
+        if (kk > values_.size())
+        {
+            values_.resize(static_cast<size_t>(1.20 * (kk + 1)));
+            dTaus_.resize(values_.size());
+            rowIndices_.resize(values_.size());
+            binOffsets_.resize(values_.size());
+        }
+    }
+
+    // The sums over the bins of the pair ll, S_k(n) = sum_ii Mk[ii] e^{i w_n dTau ii} for n < NMat_. As w_n dTau ii =
+    // pi (2n + 1) ii / N_BIN_TAU, S_k is the DFT of Mk[ii] e^{i pi ii / N_BIN_TAU} at -n. The moments are real, so M0 + i M1 and
+    // M2 + i M3 share a FFT, separated with S_k(N_BIN_TAU - 1 - n) = conj(S_k(n)).
+    BinSums_t BinSums(const size_t &ll, const arma::cx_vec &phases) const
+    {
+        const double *const bins = bins_.data() + ll * N_MOMENTS * N_BIN_TAU;
+        BinSums_t sums;
+        for (size_t kk = 0; kk < N_MOMENTS; kk += 2)
+        {
+            arma::cx_vec moments(N_BIN_TAU);
+            for (size_t ii = 0; ii < N_BIN_TAU; ii++)
+            {
+                moments(ii) = phases(ii) * cd_t(bins[N_MOMENTS * ii + kk], bins[N_MOMENTS * ii + kk + 1]);
+            }
+            const arma::cx_vec transformed = arma::fft(moments);
+
+            sums[kk].set_size(NMat_);
+            sums[kk + 1].set_size(NMat_);
+            for (size_t n = 0; n < NMat_; ++n)
+            {
+                const cd_t yy = transformed((N_BIN_TAU - n % N_BIN_TAU) % N_BIN_TAU);
+                const cd_t yyMirror = std::conj(transformed((n + 1) % N_BIN_TAU));
+                sums[kk](n) = 0.5 * (yy + yyMirror);
+                sums[kk + 1](n) = cd_t(0.0, -0.5) * (yy - yyMirror);
+            }
+        }
+        return sums;
+    }
+
+    // BinSums of all the independent pairs, spread over nThreads_ threads (they only read the bins).
+    std::vector<BinSums_t> BinSumsThreads() const
+    {
+        arma::cx_vec phases(N_BIN_TAU);
+        for (size_t ii = 0; ii < N_BIN_TAU; ii++)
+        {
+            phases(ii) = std::polar(1.0, M_PI * static_cast<double>(ii) / static_cast<double>(N_BIN_TAU));
+        }
+
+        std::vector<BinSums_t> result(ioModelPtr_->GetNIndepSuperSites(NOrb_));
+        const size_t nWorkers = std::max<size_t>(1, std::min(nThreads_, result.size()));
+        std::vector<std::thread> threads;
+        std::vector<std::exception_ptr> exceptions(nWorkers);
+        for (size_t ii = 0; ii < nWorkers; ii++)
+        {
+            threads.emplace_back([this, &phases, &result, &exceptions, nWorkers, ii]() {
+                try
+                {
+                    for (size_t ll = ii; ll < result.size(); ll += nWorkers)
+                    {
+                        result.at(ll) = BinSums(ll, phases);
+                    }
+                }
+                catch (...)
+                {
+                    exceptions.at(ii) = std::current_exception();
+                }
+            });
+        }
+
+        for (auto &thread : threads)
+        {
+            thread.join();
+        }
+
+        for (const auto &exception : exceptions)
+        {
+            if (exception)
+            {
+                std::rethrow_exception(exception);
+            }
+        }
+        return result;
+    }
+
     std::shared_ptr<ISDataCT> dataCT_;
     std::shared_ptr<Model_t> modelPtr_;
     std::shared_ptr<IOModel_t> ioModelPtr_;
 
-    std::vector<std::vector<double>> M0Bins_;
-    std::vector<std::vector<double>> M1Bins_;
-    std::vector<std::vector<double>> M2Bins_;
-    std::vector<std::vector<double>> M3Bins_;
+    // The 4 moments M0, M1, M2, M3 of a bin side by side, bins_[(ll * N_BIN_TAU + bin) * N_MOMENTS + moment].
+    std::vector<double> bins_;
+    size_t nSuperSites_{0};
+    std::vector<size_t> pairOffsets_;
+
+    std::vector<size_t> rowIndices_;
+    std::vector<size_t> binOffsets_;
+    std::vector<double> values_;
+    std::vector<double> dTaus_;
 
     ClusterCubeCD_t greenCube_;
 
     const size_t NMat_;
     const FermionSpin_t spin_;
     const size_t NOrb_;
+    const size_t nThreads_;
 };
 
 } // namespace Obs
@@ -0,0 +1,167 @@
+#pragma once
+
+#include "ctmo/Foundations/LinAlg.hpp"
+#include "ctmo/ImpuritySolver/ISData.hpp"
+#include <boost/math/special_functions/bessel.hpp>
+#include <cmath>
+
+namespace Markov
+{
+namespace Obs
+{
+using IOModel_t = IO::Base_IOModel;
+using Model_t = Models::ABC_Model_2D;
+
+// Measurement of the green function in the basis of the Legendre polynomials (Boehnke et al., PRB 84, 075145 (2011)), instead of
+// the bins of GreenBinning, with solver.nLegendre > 0. For each independent pair, the M contributions are accumulated at
+// x = 2 tau / beta - 1 in the coefficients M_l = sqrt(2l + 1) sum P_l(x) M(tau), l < nLegendre, then transformed to the matsubara
+// frequencies analytically, M(iwn) = sum_l T_nl M_l. A few tens of coefficients per pair replace the 4 x N_BIN_TAU bins, and the
+// truncation of the series filters the noise of the high frequencies.
+class GreenLegendre
+{
+
+  public:
+    GreenLegendre(std::shared_ptr<ISDataCT> dataCT, const Json &jjSim, const FermionSpin_t &spin)
+        : dataCT_(std::move(dataCT)), modelPtr_(dataCT_->modelPtr_), ioModelPtr_(modelPtr_->ioModelPtr()),
+          NMat_(static_cast<size_t>(0.5 * (jjSim["solver"]["eCutGreen"].get<double>() * dataCT_->beta() / M_PI - 1.0))), spin_(spin),
+          NOrb_(jjSim["model"]["nOrb"].get<size_t>()), NLegendre_(NLegendre(jjSim))
+    {
+        if (NLegendre_ < 2)
+        {
+            throw std::runtime_error("solver.nLegendre should be >= 2.");
+        }
+
+        coeffs_.resize(ioModelPtr_->GetNIndepSuperSites(NOrb_), std::vector<double>(NLegendre_, 0.0));
+
+        // P_{l+1}(x) = recurrenceA_[l] x P_l(x) - recurrenceB_[l] P_{l-1}(x)
+        recurrenceA_.resize(NLegendre_);
+        recurrenceB_.resize(NLegendre_);
+        for (size_t ll = 0; ll < NLegendre_; ++ll)
+        {
+            recurrenceA_.at(ll) = (2.0 * ll + 1.0) / (ll + 1.0);
+            recurrenceB_.at(ll) = ll / (ll + 1.0);
+        }
+
+        Logging::Trace("GreenLegendre Created.");
+    }
+
+    // The number of Legendre coefficients, 0 to measure with GreenBinning.
+    static size_t NLegendre(const Json &jjSim) { return jjSim["solver"].value("nLegendre", size_t(0)); }
+
+    // T_nl = (-1)^n i^{l+1} sqrt(2l + 1) j_l((2n + 1) pi / 2), so that f(iwn) = sum_l T_nl f_l for
+    // f(tau) = sum_l sqrt(2l + 1) / beta f_l P_l(x(tau)).
+    static ClusterMatrixCD_t MatsubaraTransform(const size_t &NMat, const size_t &NLegendre)
+    {
+        ClusterMatrixCD_t transform(NMat, NLegendre);
+        for (size_t n = 0; n < NMat; ++n)
+        {
+            cd_t il(0.0, (n % 2 == 0) ? 1.0 : -1.0);
+            for (size_t ll = 0; ll < NLegendre; ++ll)
+            {
+                const double besselJ = boost::math::sph_bessel(static_cast<unsigned>(ll), (2.0 * n + 1.0) * M_PI / 2.0);
+                transform(n, ll) = il * std::sqrt(2.0 * ll + 1.0) * besselJ;
+                il *= cd_t(0.0, 1.0);
+            }
+        }
+        return transform;
+    }
+
+    ClusterCubeCD_t greenCube() const { return greenCube_; };
+    size_t nLegendre() const { return NLegendre_; }
+
+    void MeasureGreenLegendre(const Matrix<double> &Mmat)
+    {
+        const std::vector<SuperSite_t> &superSites = dataCT_->vertices_.parts(spin_).superSites();
+        const std::vector<Tau_t> &taus = dataCT_->vertices_.parts(spin_).taus();
+        const size_t kkSpin = taus.size();
+        const double xFactor = 2.0 / dataCT_->beta_;
+        for (size_t p1 = 0; p1 < kkSpin; ++p1)
+        {
+            for (size_t p2 = 0; p2 < kkSpin; ++p2)
+            {
+                const size_t ll = ioModelPtr_->FindIndepSuperSiteIndex(superSites[p1], superSites[p2], NOrb_);
+                double temp = static_cast<double>(dataCT_->sign_) * Mmat(p1, p2);
+
+                double tau = taus[p1] - taus[p2];
+                if (tau < 0.0)
+                {
+                    temp *= -1.0;
+                    tau += dataCT_->beta_;
+                }
+
+                const double xx = xFactor * tau - 1.0;
+                double *coeffs = coeffs_[ll].data();
+                double pPrevious = temp;
+                double pCurrent = temp * xx;
+                coeffs[0] += pPrevious;
+                coeffs[1] += pCurrent;
+                for (size_t ii = 1; ii + 1 < NLegendre_; ++ii)
+                {
+                    const double pNext = recurrenceA_[ii] * xx * pCurrent - recurrenceB_[ii] * pPrevious;
+                    coeffs[ii + 1] += pNext;
+                    pPrevious = pCurrent;
+                    pCurrent = pNext;
+                }
+            }
+        }
+    }
+
+    ClusterCubeCD_t FinalizeGreenLegendre(const double &signMeas, const size_t &NMeas)
+    {
+        Logging::Debug("Start of GreenLegendre.FinalizeGreenLegendre()");
+
+        const ClusterMatrixCD_t transform = MatsubaraTransform(NMat_, NLegendre_);
+        SiteVectorCD_t indep_M_matsubara_sampled(ioModelPtr_->GetNIndepSuperSites(NOrb_));
+        const ClusterCubeCD_t green0CubeMatsubara =
+            spin_ == FermionSpin_t::Up ? modelPtr_->greenCluster0MatUp().data() : modelPtr_->greenCluster0MatDown().data();
+        ClusterCubeCD_t greenCube(NOrb_ * ioModelPtr_->Nc, NOrb_ * ioModelPtr_->Nc, NMat_);
+        greenCube.zeros();
+
+        for (size_t n = 0; n < NMat_; ++n)
+        {
+            for (size_t ll = 0; ll < ioModelPtr_->GetNIndepSuperSites(NOrb_); ++ll)
+            {
+                cd_t temp_matsubara = 0.0;
+                for (size_t ii = 0; ii < NLegendre_; ++ii)
+                {
+                    temp_matsubara += transform(n, ii) * std::sqrt(2.0 * ii + 1.0) * coeffs_[ll][ii];
+                }
+
+                const size_t llSite = ll % ioModelPtr_->indepSites().size();
+                indep_M_matsubara_sampled(ll) =
+                    temp_matsubara / (static_cast<double>(NMeas) * static_cast<double>(ioModelPtr_->nOfAssociatedSites().at(llSite)));
+            }
+            const ClusterMatrixCD_t dummy1 = ioModelPtr_->IndepToFull(indep_M_matsubara_sampled, NOrb_);
+            const ClusterMatrixCD_t &green0 = green0CubeMatsubara.slice(n);
+
+            greenCube.slice(n) = green0 - green0 * dummy1 * green0 / (dataCT_->beta_ * signMeas);
+        }
+
+        greenCube_ = greenCube;
+
+        Logging::Debug("End of GreenLegendre.FinalizeGreenLegendre()");
+        return greenCube;
+    }
+
+    // The accumulated coefficients, for the checkpoints (boost::serialization).
+    template <class Archive> void serialize(Archive &ar, const unsigned int /*version*/) { ar &coeffs_; }
+
+  private:
+    std::shared_ptr<ISDataCT> dataCT_;
+    std::shared_ptr<Model_t> modelPtr_;
+    std::shared_ptr<IOModel_t> ioModelPtr_;
+
+    std::vector<std::vector<double>> coeffs_; // sum of P_l(x) M(tau), for each independent pair
+    std::vector<double> recurrenceA_;
+    std::vector<double> recurrenceB_;
+
+    ClusterCubeCD_t greenCube_;
+
+    const size_t NMat_;
+    const FermionSpin_t spin_;
+    const size_t NOrb_;
+    const size_t NLegendre_;
+};
+
+} // namespace Obs
+} // namespace Markov
@@ -8,13 +8,14 @@
 namespace Markov
 {
 
-class ABC_MarkovChain;
+template <typename TMarkovChain_t, typename TNScalar_t> class ABC_MarkovChain;
 
 namespace Obs
 {
 
 class FillingAndDocc;
 class GreenBinning;
+class GreenLegendre;
 class Observables;
 
 using namespace LinAlg;
@@ -27,11 +28,11 @@ class ISDataCT
     ISDataCT(const Json &jjSim, const std::shared_ptr<Models::ABC_Model_2D> &modelPtr)
         : modelPtr_(modelPtr),
 #ifdef AFM
-          green0CachedUp_(modelPtr->greenCluster0MatUp(), modelPtr_->ioModelPtr(), jjSim["solver"]["ntau"]),
-          green0CachedDown_(modelPtr->greenCluster0MatDown(), modelPtr_->ioModelPtr(), jjSim["solver"]["ntau"]),
+          green0CachedUp_(BuildGreen0Tau(modelPtr->greenCluster0MatUp(), jjSim)),
+          green0CachedDown_(BuildGreen0Tau(modelPtr->greenCluster0MatDown(), jjSim)),
 #endif
 #ifndef AFM
-          green0CachedUp_(modelPtr->greenCluster0MatUp(), modelPtr_->ioModelPtr(), jjSim["solver"]["ntau"]),
+          green0CachedUp_(BuildGreen0Tau(modelPtr->greenCluster0MatUp(), jjSim)),
 #endif
           MupPtr_(new Matrix_t()), MdownPtr_(new Matrix_t()), beta_(modelPtr->beta()), NOrb_(modelPtr->NOrb()), sign_(1)
 
@@ -42,17 +43,38 @@ class ISDataCT
     double beta() const { return beta_; };
     double NOrb() const { return NOrb_; };
 
+    // Data for another chain of the same process: the model and the G0 tables are shared (read only), not rebuilt.
+    std::shared_ptr<ISDataCT> ShareTables() const
+    {
+        std::shared_ptr<ISDataCT> dataCTPtr(new ISDataCT(*this));
+        dataCTPtr->MupPtr_.reset(new Matrix_t());
+        dataCTPtr->MdownPtr_.reset(new Matrix_t());
+        dataCTPtr->vertices_.Clear();
+        dataCTPtr->sign_ = 1;
+        return dataCTPtr;
+    }
+
   private:
+    std::shared_ptr<const GreenTau_t> BuildGreen0Tau(const GreenMat::GreenCluster0Mat &green0Mat, const Json &jjSim) const
+    {
+        const Json &jjSolver = jjSim["solver"];
+        return std::make_shared<GreenTau_t>(green0Mat, modelPtr_->ioModelPtr(), jjSolver["ntau"].get<size_t>(),
+                                            mpiUt::ReplicaLadder(jjSim).Index(), GreenTau_t::InterpolationOf(jjSolver),
+                                            jjSolver.value("g0SinglePrecision", false), jjSolver.value("nThreads", size_t(1)),
+                                            jjSolver.value("g0NodeShared", false), jjSolver.value("g0CacheDir", std::string()));
+    }
+
     friend class Markov::Obs::Observables;
     friend class Markov::Obs::GreenBinning;
+    friend class Markov::Obs::GreenLegendre;
     friend class Markov::Obs::FillingAndDocc;
 
-    friend class Markov::ABC_MarkovChain;
+    template <typename TMarkovChain_t, typename TNScalar_t> friend class Markov::ABC_MarkovChain;
 
     std::shared_ptr<Models::ABC_Model_2D> modelPtr_;
-    GreenTau_t green0CachedUp_;
+    std::shared_ptr<const GreenTau_t> green0CachedUp_;
 #ifdef AFM
-    GreenTau_t green0CachedDown_;
+    std::shared_ptr<const GreenTau_t> green0CachedDown_;
 #endif
     std::shared_ptr<Matrix_t> MupPtr_;
     std::shared_ptr<Matrix_t> MdownPtr_;
@@ -17,8 +17,9 @@ class IOResult
   public:
     static void SaveISResults(const std::vector<Result::ISResult> &isResultVec, const IO::Base_IOModel &ioModel, const double &beta)
     {
-        const int nworkers = Tools::NWorkers();
-        assert(nworkers == int(isResultVec.size()));
+        // One result per chain, there can be many chains per process.
+        const int nworkers = isResultVec.size();
+        assert(nworkers >= Tools::NWorkers());
         const size_t n_cols = isResultVec.at(0).n_cols_;
         const size_t n_rows = isResultVec.at(0).n_rows_;
         const size_t fillingSize = ioModel.fillingSites().size();
@@ -69,11 +70,37 @@ class IOResult
         StatsJsons(isResultVec);
     }
 
+    // Gather on the master the results of the chains of all the processes.
+    static std::vector<Result::ISResult> GatherISResults(const std::vector<Result::ISResult> &isResultVecLocal)
+    {
+#ifdef HAVEMPI
+        mpi::communicator world;
+        std::vector<std::vector<Result::ISResult>> isResultVecVec;
+        if (Tools::Rank() == Tools::master)
+        {
+            mpi::gather(world, isResultVecLocal, isResultVecVec, Tools::master);
+        }
+        else
+        {
+            mpi::gather(world, isResultVecLocal, Tools::master);
+        }
+
+        std::vector<Result::ISResult> isResultVec;
+        for (const auto &isResultVecRank : isResultVecVec)
+        {
+            isResultVec.insert(isResultVec.end(), isResultVecRank.begin(), isResultVecRank.end());
+        }
+        return isResultVec;
+#else
+        return isResultVecLocal;
+#endif
+    }
+
     static void StatsJsons(const std::vector<Result::ISResult> &isResultVec)
     {
         Json jjResult(isResultVec.at(0).obsScal_);
 
-        const size_t nworkers = Tools::NWorkers();
+        const size_t nworkers = isResultVec.size();
         const size_t jjSize = jjResult.size();
 
         // START STATS===================================================================
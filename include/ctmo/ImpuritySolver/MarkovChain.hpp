@@ -6,54 +6,42 @@
 namespace Markov
 {
 
-class MarkovChain : public ABC_MarkovChain
+// TAuxHelper_t gives the aux values, TNScalar_t the precision of the N matrices (float for the mixed precision mode).
+template <typename TAuxHelper_t, typename TNScalar_t = double>
+class MarkovChainT : public ABC_MarkovChain<MarkovChainT<TAuxHelper_t, TNScalar_t>, TNScalar_t>
 {
-
   public:
-    MarkovChain(const Json &jjSim, const size_t &seed) : ABC_MarkovChain(jjSim, seed), auxH_(jjSim["model"]["delta"].get<double>()){};
+    using Base_t = ABC_MarkovChain<MarkovChainT<TAuxHelper_t, TNScalar_t>, TNScalar_t>;
 
-    MarkovChain(const MarkovChain &markovChain) = default;
-    MarkovChain(MarkovChain &&markovChain) = default;
-    MarkovChain &operator=(const MarkovChain &markovChain) = delete;
-    MarkovChain &operator=(MarkovChain &&markovChain) = delete;
+    MarkovChainT(const Json &jjSim, const size_t &seed) : Base_t(jjSim, seed), auxH_(jjSim["model"]["delta"].get<double>()){};
 
-    ~MarkovChain() override = default;
+    MarkovChainT(const Json &jjSim, const size_t &seed, const MarkovChainT &shared)
+        : Base_t(jjSim, seed, shared), auxH_(jjSim["model"]["delta"].get<double>()){};
 
-#ifdef GREEN_STYLE
-    double FAux(const VertexPart &vp) const override
-    {
-        if (vp.vtype() == Diagrammatic::VertexType::Phonon)
-        {
-            return (auxH_.auxPh(vp.aux()));
-        }
-        else
-        {
-            return (auxH_.auxValue(vp.spin(), vp.aux()));
-        }
-    }
-
-    double FAuxBar(const VertexPart &vp) const override
-    {
-        if (vp.vtype() == Diagrammatic::VertexType::Phonon)
-        {
-            return (auxH_.auxPh(vp.aux()));
-        }
-        else
-        {
-            return (auxH_.auxValueBar(vp.spin(), vp.aux()));
-        }
-    }
+    MarkovChainT(const MarkovChainT &markovChain) = default;
+    MarkovChainT(MarkovChainT &&markovChain) = default;
+    MarkovChainT &operator=(const MarkovChainT &markovChain) = delete;
+    MarkovChainT &operator=(MarkovChainT &&markovChain) = delete;
 
-#else
-    double FAux(const VertexPart &vp) const override { return (auxH_.FAux(vp)); }
+    ~MarkovChainT() = default;
 
-    double FAuxBar(const VertexPart &vp) const override { return (auxH_.FAuxBar(vp)); }
+    double FAux(const VertexPart &vp) const { return (auxH_.FAux(vp)); }
 
-    double gamma(const VertexPart &vpI, const VertexPart &vpJ) const override { return auxH_.gamma(vpI, vpJ); }
+    double FAuxBar(const VertexPart &vp) const { return (auxH_.FAuxBar(vp)); }
 
-#endif
+    double gamma(const VertexPart &vpI, const VertexPart &vpJ) const { return auxH_.gamma(vpI, vpJ); }
 
   private:
-    Diagrammatic::AuxHelper auxH_;
+    TAuxHelper_t auxH_;
 };
+
+// The aux helper stays a build choice: GREEN_STYLE also changes the insertions of the VertexBuilder (ctmo_green is a test binary).
+#ifdef GREEN_STYLE
+using AuxHelper_t = Diagrammatic::AuxHelperGreenStyle;
+#else
+using AuxHelper_t = Diagrammatic::AuxHelper;
+#endif
+
+using MarkovChain = MarkovChainT<AuxHelper_t>;
+
 } // namespace Markov
@@ -2,6 +2,7 @@
 
 #include "ctmo/ImpuritySolver/MPIResult.hpp"
 #include "ctmo/ImpuritySolver/GreenBinning.hpp"
+#include "ctmo/ImpuritySolver/GreenLegendre.hpp"
 #include "ctmo/ImpuritySolver/FillingAndDocc.hpp"
 #include "ctmo/ImpuritySolver/KineticEnergy.hpp"
 #include "ctmo/ImpuritySolver/ISResult.hpp"
@@ -18,23 +19,42 @@ class Observables
 
   public:
     // Observables(){};
-    Observables(std::shared_ptr<ISDataCT> dataCT, const Json &jjSim)
+    Observables(std::shared_ptr<ISDataCT> dataCT, const Json &jjSim, const size_t &seedShift = 0)
         : dataCT_(std::move(dataCT)), modelPtr_(dataCT_->modelPtr_), ioModelPtr_(modelPtr_->ioModelPtr()),
-          rng_(jjSim["monteCarlo"]["seed"].get<size_t>() + mpiUt::Tools::Rank() * mpiUt::Tools::Rank()),
+          rng_(jjSim["monteCarlo"]["seed"].get<size_t>() + mpiUt::Tools::Rank() * mpiUt::Tools::Rank() + seedShift),
           urngPtr_(new Utilities::UniformRngFibonacci3217_t(rng_, Utilities::UniformDistribution_t(0.0, 1.0))),
-          greenBinningUp_(dataCT_, jjSim, FermionSpin_t::Up), greenBinningDown_(dataCT_, jjSim, FermionSpin_t::Down),
           fillingAndDocc_(dataCT_, urngPtr_, jjSim["solver"]["n_tau_sampling"].get<size_t>()), signMeas_(0.0), expOrder_(0.0), NMeas_(0),
-          NOrb_(jjSim["model"]["nOrb"].get<size_t>()), averageOrbitals_(jjSim["solver"]["averageOrbitals"].get<bool>())
+          updatesMeas_(jjSim["solver"].value("updatesMeas", size_t(1))), NOrb_(jjSim["model"]["nOrb"].get<size_t>()),
+          averageOrbitals_(jjSim["solver"]["averageOrbitals"].get<bool>())
     {
 
         Logging::Debug("In Obs constructor ");
 
+        if (GreenLegendre::NLegendre(jjSim) > 0)
+        {
+            greenLegendreUp_ = std::make_unique<GreenLegendre>(dataCT_, jjSim, FermionSpin_t::Up);
+            greenLegendreDown_ = std::make_unique<GreenLegendre>(dataCT_, jjSim, FermionSpin_t::Down);
+        }
+        else
+        {
+            greenBinningUp_ = std::make_unique<GreenBinning>(dataCT_, jjSim, FermionSpin_t::Up);
+            greenBinningDown_ = std::make_unique<GreenBinning>(dataCT_, jjSim, FermionSpin_t::Down);
+        }
+
         Logging::Debug("After Obs  constructor ");
     }
 
     // Getters
     double signMeas() const { return signMeas_; };
     double expOrder() const { return expOrder_; };
+    size_t updatesMeas() const { return updatesMeas_; };
+
+    // The measurement interval chosen by the monte carlo (see MC::MeasurementCadence), saved in Obs.json.
+    void SetUpdatesMeas(const size_t &updatesMeas, const double &autocorrelationTime)
+    {
+        updatesMeas_ = updatesMeas;
+        autocorrelationTime_ = autocorrelationTime;
+    }
 
     void Measure()
     {
@@ -45,13 +65,74 @@ class Observables
 
         fillingAndDocc_.MeasureFillingAndDocc();
 
-        greenBinningUp_.MeasureGreenBinning(*dataCT_->MupPtr_);
-        greenBinningDown_.MeasureGreenBinning(*dataCT_->MdownPtr_);
+        if (greenLegendreUp_)
+        {
+            greenLegendreUp_->MeasureGreenLegendre(*dataCT_->MupPtr_);
+            greenLegendreDown_->MeasureGreenLegendre(*dataCT_->MdownPtr_);
+        }
+        else
+        {
+            greenBinningUp_->MeasureGreenBinning(*dataCT_->MupPtr_);
+            greenBinningDown_->MeasureGreenBinning(*dataCT_->MdownPtr_);
+        }
     }
 
-    void Save()
+    // The scalars of the last measurement: the sign, and the expansion order, filling and double occupancy weighted by the sign.
+    std::array<double, 4> MeasuredScalars() const
+    {
+        const auto sign = static_cast<double>(dataCT_->sign_);
+        return {sign, sign * static_cast<double>(dataCT_->vertices_.size()),
+                fillingAndDocc_.fillingUpTotalCurrent() + fillingAndDocc_.fillingDownTotalCurrent(), fillingAndDocc_.doccTotalCurrent()};
+    }
+
+    // The accumulated measurements and the random engine, for the checkpoints (boost::serialization archives). The green function
+    // is the one of the measurement in use, preceded by its mode and solver.nLegendre: a checkpoint is restarted with the same ones.
+    template <class Archive> void SaveCheckpoint(Archive &ar) const
+    {
+        ar << signMeas_ << expOrder_ << NMeas_ << updatesMeas_ << autocorrelationTime_;
+        const bool isLegendre = static_cast<bool>(greenLegendreUp_);
+        const size_t nLegendreMeas = nLegendre();
+        ar << isLegendre << nLegendreMeas;
+        if (greenLegendreUp_)
+        {
+            ar << *greenLegendreUp_ << *greenLegendreDown_;
+        }
+        else
+        {
+            ar << *greenBinningUp_ << *greenBinningDown_;
+        }
+        ar << fillingAndDocc_;
+        ar << Utilities::EngineState(rng_);
+    }
+
+    template <class Archive> void LoadCheckpoint(Archive &ar)
+    {
+        ar >> signMeas_ >> expOrder_ >> NMeas_ >> updatesMeas_ >> autocorrelationTime_;
+        bool isLegendre = false;
+        size_t nLegendreMeas = 0;
+        ar >> isLegendre >> nLegendreMeas;
+        if ((isLegendre != static_cast<bool>(greenLegendreUp_)) || (nLegendreMeas != nLegendre()))
+        {
+            throw std::runtime_error("The checkpoint was measured with solver.nLegendre = " + std::to_string(nLegendreMeas) +
+                                     ", restart it with the same value (now " + std::to_string(nLegendre()) + ").");
+        }
+        if (greenLegendreUp_)
+        {
+            ar >> *greenLegendreUp_ >> *greenLegendreDown_;
+        }
+        else
+        {
+            ar >> *greenBinningUp_ >> *greenBinningDown_;
+        }
+        ar >> fillingAndDocc_;
+        std::string rngState;
+        ar >> rngState;
+        Utilities::SetEngineState(rng_, rngState);
+    }
+
+    // Finalize the measurements of this chain.
+    Result::ISResult GetISResult()
     {
-        Logging::Info("Start of Observables.Save()");
         signMeas_ /= NMeas_;
 
         fillingAndDocc_.Finalize(signMeas_, NMeas_);
@@ -61,13 +142,17 @@ class Observables
 
         obsScal["sign"] = signMeas_;
         obsScal["NMeas"] = NMeas_;
+        obsScal["updatesMeas"] = updatesMeas_;
+        obsScal["autocorrelationTime"] = autocorrelationTime_;
 
         // dont forget that the following obs have not been finalized (multiplied by following factor)
         const double fact = 1.0 / (NMeas_ * signMeas_);
         obsScal["k"] = fact * expOrder_;
 
-        ClusterCubeCD_t greenCubeMatUp = greenBinningUp_.FinalizeGreenBinning(signMeas_, NMeas_);
-        ClusterCubeCD_t greenCubeMatDown = greenBinningDown_.FinalizeGreenBinning(signMeas_, NMeas_);
+        ClusterCubeCD_t greenCubeMatUp = greenLegendreUp_ ? greenLegendreUp_->FinalizeGreenLegendre(signMeas_, NMeas_)
+                                                          : greenBinningUp_->FinalizeGreenBinning(signMeas_, NMeas_);
+        ClusterCubeCD_t greenCubeMatDown = greenLegendreDown_ ? greenLegendreDown_->FinalizeGreenLegendre(signMeas_, NMeas_)
+                                                              : greenBinningDown_->FinalizeGreenBinning(signMeas_, NMeas_);
 
         // Average the green Functions if orbitals have the same parameters
         if (averageOrbitals_)
@@ -79,36 +164,26 @@ class Observables
         ClusterMatrixCD_t greenMatsubaraUp = ioModelPtr_->FullCubeToIndep(greenCubeMatUp);
         ClusterMatrixCD_t greenMatsubaraDown = ioModelPtr_->FullCubeToIndep(greenCubeMatDown);
 
-// Gather and stats of all the results for all cores
 #ifndef AFM
         greenMatsubaraUp = 0.5 * (greenMatsubaraUp + greenMatsubaraDown);
         greenMatsubaraDown = greenMatsubaraUp;
 #endif
 
-        Result::ISResult isResult(obsScal, greenMatsubaraUp, greenMatsubaraDown, fillingAndDocc_.fillingUp(),
-                                  fillingAndDocc_.fillingDown());
-        std::vector<Result::ISResult> isResultVec;
-#ifdef HAVEMPI
+        return Result::ISResult(obsScal, greenMatsubaraUp, greenMatsubaraDown, fillingAndDocc_.fillingUp(), fillingAndDocc_.fillingDown());
+    }
+
+    void Save() { SaveISResults({GetISResult()}); }
 
-        mpi::communicator world;
-        if (mpiUt::Tools::Rank() == mpiUt::Tools::master)
-        {
-            mpi::gather(world, isResult, isResultVec, mpiUt::Tools::master);
-        }
-        else
-        {
-            mpi::gather(world, isResult, mpiUt::Tools::master);
-        }
+    // Gather and stats of the results of all the chains, of this process and of all the others.
+    void SaveISResults(const std::vector<Result::ISResult> &isResultVecLocal) const
+    {
+        Logging::Info("Start of Observables.Save()");
+        const std::vector<Result::ISResult> isResultVec = mpiUt::IOResult::GatherISResults(isResultVecLocal);
         if (mpiUt::Tools::Rank() == mpiUt::Tools::master)
         {
             mpiUt::IOResult::SaveISResults(isResultVec, *ioModelPtr_, dataCT_->beta_);
         }
 
-#else
-        isResultVec.push_back(isResult);
-        mpiUt::IOResult::SaveISResults(isResultVec, *ioModelPtr_, dataCT_->beta_);
-#endif
-
         // Start: This should be in PostProcess.cpp ?
         // Start of observables that are easier and ok to do once all has been saved (for exemples, depends only on final green function)
         // Get KinecticEnergy
@@ -137,14 +212,20 @@ class Observables
     }
 
   private:
+    // 0 for the measurement with GreenBinning.
+    size_t nLegendre() const { return greenLegendreUp_ ? greenLegendreUp_->nLegendre() : 0; }
+
     std::shared_ptr<ISDataCT> dataCT_;
     std::shared_ptr<Model_t> modelPtr_;
     std::shared_ptr<IOModel_t> ioModelPtr_;
     Utilities::EngineTypeFibonacci3217_t rng_;
     std::shared_ptr<Utilities::UniformRngFibonacci3217_t> urngPtr_;
 
-    GreenBinning greenBinningUp_;
-    GreenBinning greenBinningDown_;
+    // Only one of the two measurements of the green function is allocated, the Legendre one with solver.nLegendre > 0.
+    std::unique_ptr<GreenBinning> greenBinningUp_;
+    std::unique_ptr<GreenBinning> greenBinningDown_;
+    std::unique_ptr<GreenLegendre> greenLegendreUp_;
+    std::unique_ptr<GreenLegendre> greenLegendreDown_;
     FillingAndDocc fillingAndDocc_;
 
     Matrix_t Maveraged_;
@@ -154,6 +235,8 @@ class Observables
     double expOrder_;
 
     size_t NMeas_;
+    size_t updatesMeas_;
+    double autocorrelationTime_{0.0}; // of the expansion order and sign, in updates, 0 if not estimated
 
     const size_t NOrb_;
     const bool averageOrbitals_;
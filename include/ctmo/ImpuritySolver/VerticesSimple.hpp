@@ -6,6 +6,10 @@
 #include "ctmo/Foundations/UtilitiesRandom.hpp"
 
 #include <boost/math/special_functions/binomial.hpp>
+#include <boost/serialization/utility.hpp>
+#include <boost/serialization/vector.hpp>
+#include <iomanip>
+#include <limits>
 
 namespace Diagrammatic
 {
@@ -66,6 +70,18 @@ class VertexPart
 
     void SetSpin(const FermionSpin_t &spin) { spin_ = spin; }
 
+    // For the checkpoints (boost::serialization).
+    template <class Archive> void serialize(Archive &ar, const unsigned int /*version*/)
+    {
+        ar &vtype_;
+        ar &tau_;
+        ar &site_;
+        ar &spin_;
+        ar &orbital_;
+        ar &superSite_;
+        ar &aux_;
+    }
+
   private:
     VertexType vtype_{VertexType::Invalid};
     Tau_t tau_{-9999.0};
@@ -117,6 +133,14 @@ class Vertex
 
     // Setters
 
+    template <class Archive> void serialize(Archive &ar, const unsigned int /*version*/)
+    {
+        ar &vtype_;
+        ar &vStart_;
+        ar &vEnd_;
+        ar &probProb_;
+    }
+
   private:
     VertexType vtype_{VertexType::Invalid};
     VertexPart vStart_;
@@ -124,6 +148,87 @@ class Vertex
     double probProb_{0.0};
 };
 
+// The vertex parts of one spin, in the order of the rows and cols of its N matrix. The tau, super site and aux of the parts are
+// also kept in columns, so that the loops over all the parts (the G0 gathers of the updates and of the measures) stream through
+// contiguous memory. owners_[i] = 2 * (index of the vertex) + (0 for its vStart, 1 for its vEnd), see Vertices::PartIndex.
+class VertexPartStore
+{
+  public:
+    size_t size() const { return parts_.size(); }
+
+    const VertexPart &operator[](const size_t &i) const { return parts_[i]; }
+
+    const VertexPart &at(const size_t &i) const { return parts_.at(i); }
+
+    const std::vector<Tau_t> &taus() const { return taus_; }
+
+    const std::vector<SuperSite_t> &superSites() const { return superSites_; }
+
+    const std::vector<AuxSpin_t> &auxs() const { return auxs_; }
+
+    size_t owner(const size_t &i) const { return owners_[i]; }
+
+    void PushBack(const VertexPart &vPart, const size_t &owner)
+    {
+        parts_.push_back(vPart);
+        taus_.push_back(vPart.tau());
+        superSites_.push_back(vPart.superSite());
+        auxs_.push_back(vPart.aux());
+        owners_.push_back(owner);
+    }
+
+    void PopBack()
+    {
+        parts_.pop_back();
+        taus_.pop_back();
+        superSites_.pop_back();
+        auxs_.pop_back();
+        owners_.pop_back();
+    }
+
+    void Swap(const size_t &i, const size_t &j)
+    {
+        std::swap(parts_[i], parts_[j]);
+        std::swap(taus_[i], taus_[j]);
+        std::swap(superSites_[i], superSites_[j]);
+        std::swap(auxs_[i], auxs_[j]);
+        std::swap(owners_[i], owners_[j]);
+    }
+
+    void FlipAux(const size_t &i)
+    {
+        parts_.at(i).FlipAux();
+        auxs_[i] = parts_[i].aux();
+    }
+
+    void SetOwner(const size_t &i, const size_t &owner) { owners_[i] = owner; }
+
+    void Clear()
+    {
+        parts_.clear();
+        taus_.clear();
+        superSites_.clear();
+        auxs_.clear();
+        owners_.clear();
+    }
+
+    template <class Archive> void serialize(Archive &ar, const unsigned int /*version*/)
+    {
+        ar &parts_;
+        ar &taus_;
+        ar &superSites_;
+        ar &auxs_;
+        ar &owners_;
+    }
+
+  private:
+    std::vector<VertexPart> parts_;
+    std::vector<Tau_t> taus_;
+    std::vector<SuperSite_t> superSites_;
+    std::vector<AuxSpin_t> auxs_;
+    std::vector<size_t> owners_;
+};
+
 class Vertices
 {
 
@@ -140,9 +245,14 @@ class Vertices
     {
         AssertSizes();
 
+        const size_t pp = data_.size();
         data_.push_back(vertex);
         verticesKeysVec_.push_back(key_);
-        AppendVertexPart(vertex.vStart());
+        const size_t ppStart = parts(vertex.vStart().spin()).size();
+        Parts(vertex.vStart().spin()).PushBack(vertex.vStart(), 2 * pp);
+        const size_t ppEnd = parts(vertex.vEnd().spin()).size();
+        Parts(vertex.vEnd().spin()).PushBack(vertex.vEnd(), 2 * pp + 1);
+        partIndices_.emplace_back(ppStart, ppEnd);
 
         // VertexParts differ by one for their id if spins are the same
         if (vertex.vStart().spin() == vertex.vEnd().spin())
@@ -150,8 +260,6 @@ class Vertices
             ++key_;
         }
 
-        AppendVertexPart(vertex.vEnd());
-
         // Update the id number once all the vertices parts have been inserted
         key_ += 3;
         AssertSizes();
@@ -160,9 +268,8 @@ class Vertices
     void AssertSizes() const
     {
 
-        assert(2 * data_.size() == (vPartUpVec_.size() + vPartDownVec_.size()));
-        assert(indexPartUpVec_.size() == vPartUpVec_.size());
-        assert(indexPartDownVec_.size() == vPartDownVec_.size());
+        assert(2 * data_.size() == (partsUp_.size() + partsDown_.size()));
+        assert(data_.size() == partIndices_.size());
         assert(data_.size() == verticesKeysVec_.size());
     }
 
@@ -171,57 +278,30 @@ class Vertices
 
         std::cout << "Start Print " << std::endl;
 
-        for (size_t ii : indexPartUpVec_)
+        for (size_t ii = 0; ii < partsUp_.size(); ii++)
         {
-            std::cout << "indexPartUpVec_.at(ii)  = " << indexPartUpVec_.at(ii) << std::endl;
+            std::cout << "partsUp_.owner(ii)  = " << partsUp_.owner(ii) << std::endl;
         }
 
-        for (size_t ii : indexPartDownVec_)
+        for (size_t ii = 0; ii < partsDown_.size(); ii++)
         {
-            std::cout << "indexPartDownVec__.at(ii)  = " << indexPartDownVec_.at(ii) << std::endl;
+            std::cout << "partsDown_.owner(ii)  = " << partsDown_.owner(ii) << std::endl;
         }
         std::cout << "End Print " << std::endl;
     }
 
-    void AppendVertexPart(const VertexPart &vPart)
+    // Index of the vStart (isEnd = false) or of the vEnd of the vertex pp in the parts of its spin, i.e. its row in the N matrix.
+    // O(1): the indices are kept up to date by SwapVertexPart and RemoveVertex.
+    size_t PartIndex(const size_t &pp, const bool &isEnd) const
     {
-
-        if (vPart.spin() == FermionSpin_t::Up)
-        {
-            vPartUpVec_.push_back(vPart);
-            indexPartUpVec_.push_back(key_);
-        }
-        else
-        {
-            vPartDownVec_.push_back(vPart);
-            indexPartDownVec_.push_back(key_);
-        }
+        return isEnd ? partIndices_.at(pp).second : partIndices_.at(pp).first;
     }
 
-    size_t GetKeyIndex(const UInt64_t &key, const FermionSpin_t &spin) const
+    // Same as above, for a vertex with one part of each spin: the index of its part of the given spin.
+    size_t PartIndex(const size_t &pp, const FermionSpin_t &spin) const
     {
-        std::vector<size_t> indices;
-        if (spin == FermionSpin_t::Up)
-        {
-            // Find in order the vertexParts corresponding to the same vertex
-
-            auto iitt = std::find(indexPartUpVec_.begin(), indexPartUpVec_.end(), key);
-            if (iitt != indexPartUpVec_.end())
-            {
-                indices.push_back(std::distance(indexPartUpVec_.begin(), iitt));
-            }
-        }
-        else
-        {
-            auto iitt = std::find(indexPartDownVec_.begin(), indexPartDownVec_.end(), key);
-            if (iitt != indexPartDownVec_.end())
-            {
-                indices.push_back(std::distance(indexPartDownVec_.begin(), iitt));
-            }
-        }
-
-        assert(indices.size() == 1);
-        return (indices.at(0));
+        assert(data_.at(pp).vStart().spin() != data_.at(pp).vEnd().spin());
+        return PartIndex(pp, data_.at(pp).vStart().spin() != spin);
     }
 
     UInt64_t GetKey(const size_t &pp) const
@@ -231,127 +311,109 @@ class Vertices
         return verticesKeysVec_.at(pp);
     }
 
-    void SaveConfig(const std::string &fname)
+    // One vertex per line: aux site tau spinStart spinEnd orbitalStart orbitalEnd tauEnd vtype. The last two columns (not in the
+    // older files) are needed to reload the phonon vertices, see ABC_MarkovChain::LoadConfiguration.
+    void SaveConfig(const std::string &fname) const
     {
         std::ofstream fout(fname);
+        fout << std::setprecision(std::numeric_limits<double>::max_digits10);
         for (size_t ii = 0; ii < size(); ii++)
         {
             const auto x = data_.at(ii).vStart();
             const auto y = data_.at(ii).vEnd();
             fout << static_cast<int>(x.aux()) << " " << x.site() << " " << x.tau() << " " << static_cast<int>(x.spin()) << " "
-                 << static_cast<int>(y.spin()) << " " << x.orbital() << " " << y.orbital() << " " << std::endl;
+                 << static_cast<int>(y.spin()) << " " << x.orbital() << " " << y.orbital() << " " << y.tau() << " "
+                 << static_cast<int>(x.vtype()) << " \n";
         }
     }
 
+    // Swaps the vertex pp with the last one and removes it. Its parts should be popped after, with PopBackVertexPart.
     void RemoveVertex(const size_t &pp)
     {
         const size_t kkm1 = size() - 1;
-        std::iter_swap(data_.begin() + pp, data_.begin() + kkm1); // swap the last vertex and the vertex pp in vertices.
-        std::iter_swap(verticesKeysVec_.begin() + pp,
-                       verticesKeysVec_.begin() + kkm1); // swap the last vertex and the vertex pp in vertices.
+        std::swap(data_[pp], data_[kkm1]); // swap the last vertex and the vertex pp in vertices.
+        std::swap(verticesKeysVec_[pp], verticesKeysVec_[kkm1]);
+        std::swap(partIndices_[pp], partIndices_[kkm1]);
         data_.pop_back();
         verticesKeysVec_.pop_back();
-    }
-
-    void EraseVertexOneOrbital(const size_t &pp)
-    {
-        data_.erase(data_.begin() + pp);
-        verticesKeysVec_.erase(verticesKeysVec_.begin() + pp);
-
-        vPartUpVec_.erase(vPartUpVec_.begin() + pp);
-        vPartDownVec_.erase(vPartDownVec_.begin() + pp);
+        partIndices_.pop_back();
 
-        indexPartUpVec_.erase(indexPartUpVec_.begin() + pp);
-        indexPartDownVec_.erase(indexPartDownVec_.begin() + pp);
+        if (pp != kkm1)
+        {
+            Parts(data_[pp].vStart().spin()).SetOwner(partIndices_[pp].first, 2 * pp);
+            Parts(data_[pp].vEnd().spin()).SetOwner(partIndices_[pp].second, 2 * pp + 1);
+        }
     }
 
-    void SwapVertexOneOrbital(const size_t &pp, const size_t &ii)
+    // Flip the aux spin of the vertex pp and of its two vertex parts, at index ppUp and ppDown.
+    void FlipAux(const size_t &pp, const size_t &ppUp, const size_t &ppDown)
     {
-        std::iter_swap(data_.begin() + pp, data_.begin() + ii);
-        std::iter_swap(verticesKeysVec_.begin() + pp, verticesKeysVec_.begin() + ii);
-
-        std::iter_swap(vPartUpVec_.begin() + pp, vPartUpVec_.begin() + ii);
-        std::iter_swap(vPartDownVec_.begin() + pp, vPartDownVec_.begin() + ii);
-
-        std::iter_swap(indexPartUpVec_.begin() + pp, indexPartUpVec_.begin() + ii);
-        std::iter_swap(indexPartDownVec_.begin() + pp, indexPartDownVec_.begin() + ii);
+        data_.at(pp).FlipAux();
+        partsUp_.FlipAux(ppUp);
+        partsDown_.FlipAux(ppDown);
+        assert(partsUp_[ppUp].aux() == data_.at(pp).aux());
+        assert(partsDown_[ppDown].aux() == data_.at(pp).aux());
     }
 
-    void Resize(const size_t &ss)
-    {
-        data_.resize(ss);
-        verticesKeysVec_.resize(ss);
-
-        vPartUpVec_.resize(ss);
-        vPartDownVec_.resize(ss);
-
-        indexPartUpVec_.resize(ss);
-        indexPartDownVec_.resize(ss);
-    }
-
-    void PopBackVertexPart(const FermionSpin_t &spin)
-    {
-        if (spin == FermionSpin_t::Up)
-        {
-            vPartUpVec_.pop_back();
-            indexPartUpVec_.pop_back();
-        }
-        else
-        {
-            vPartDownVec_.pop_back();
-            indexPartDownVec_.pop_back();
-        }
-    }
+    void PopBackVertexPart(const FermionSpin_t &spin) { Parts(spin).PopBack(); }
 
     void SwapVertexPart(const size_t &pp1, const size_t &pp2, const FermionSpin_t &spin)
     {
-
-        if (spin == FermionSpin_t::Up)
+        VertexPartStore &partsSpin = Parts(spin);
+        partsSpin.Swap(pp1, pp2);
+        for (const size_t ii : {pp1, pp2})
         {
-            std::iter_swap(vPartUpVec_.begin() + pp1, vPartUpVec_.begin() + pp2);
-            std::iter_swap(indexPartUpVec_.begin() + pp1, indexPartUpVec_.begin() + pp2);
-        }
-        else
-        {
-
-            std::iter_swap(vPartDownVec_.begin() + pp1, vPartDownVec_.begin() + pp2);
-            std::iter_swap(indexPartDownVec_.begin() + pp1, indexPartDownVec_.begin() + pp2);
+            const size_t owner = partsSpin.owner(ii);
+            std::pair<size_t, size_t> &indices = partIndices_.at(owner / 2);
+            ((owner % 2) == 0 ? indices.first : indices.second) = ii;
         }
     }
 
     // Getters and setters
     size_t size() const { return data_.size(); };
 
-    size_t NUp() const { return vPartUpVec_.size(); };
-    size_t NDown() const { return vPartDownVec_.size(); };
+    size_t NUp() const { return partsUp_.size(); };
+    size_t NDown() const { return partsDown_.size(); };
 
     const std::vector<UInt64_t> verticesKeysVec() const { return verticesKeysVec_; }; // Each vertex has a unqique key identifying it
 
-    const Vertex at(const size_t &i) const { return data_.at(i); };
+    const Vertex &at(const size_t &i) const { return data_.at(i); };
     Vertex &at(const size_t &i) { return data_.at(i); };
 
-    const VertexPart atUp(const size_t &i) const { return vPartUpVec_.at(i); };
-    const VertexPart atDown(const size_t &i) const { return vPartDownVec_.at(i); };
+    const VertexPart &atUp(const size_t &i) const { return partsUp_.at(i); };
+    const VertexPart &atDown(const size_t &i) const { return partsDown_.at(i); };
+
+    // The vertex parts of a spin, in the order of the rows of its N matrix.
+    const VertexPartStore &parts(const FermionSpin_t &spin) const { return (spin == FermionSpin_t::Up) ? partsUp_ : partsDown_; }
 
     void Clear()
     {
         data_.clear();
-        vPartUpVec_.clear();
-        vPartDownVec_.clear();
-        indexPartUpVec_.clear();
-        indexPartDownVec_.clear();
+        partsUp_.Clear();
+        partsDown_.Clear();
+        partIndices_.clear();
         verticesKeysVec_.clear();
         key_ = 0;
     }
 
+    template <class Archive> void serialize(Archive &ar, const unsigned int /*version*/)
+    {
+        ar &data_;
+        ar &partsUp_;
+        ar &partsDown_;
+        ar &partIndices_;
+        ar &verticesKeysVec_;
+        ar &key_;
+    }
+
   private:
+    VertexPartStore &Parts(const FermionSpin_t &spin) { return (spin == FermionSpin_t::Up) ? partsUp_ : partsDown_; }
+
     std::vector<Vertex> data_;
-    std::vector<VertexPart> vPartUpVec_;
-    std::vector<VertexPart> vPartDownVec_;
-    std::vector<UInt64_t> indexPartUpVec_;
-    std::vector<UInt64_t> indexPartDownVec_; // Ex: The row and col 0 of Ndown_ is associtated to the vertexPart of the vertex given by the
-                                             // id of indexPartDownVec_.at(0)
-    std::vector<UInt64_t> verticesKeysVec_;  // Each vertex has a unqique key identifying it
+    VertexPartStore partsUp_; // Ex: The row and col 0 of Nup_ is associated to partsUp_[0], of the vertex partsUp_.owner(0) / 2
+    VertexPartStore partsDown_;
+    std::vector<std::pair<size_t, size_t>> partIndices_; // the indices of the vStart and vEnd of each vertex in partsUp_ or partsDown_
+    std::vector<UInt64_t> verticesKeysVec_;              // Each vertex has a unqique key identifying it
     UInt64_t key_{0};
 
 }; // namespace Diagrammatic
@@ -440,6 +502,29 @@ class AuxHelper
     const double delta_;
 };
 
+// Aux values used with GREEN_STYLE, for testing purpose.
+class AuxHelperGreenStyle : public AuxHelper
+{
+  public:
+    explicit AuxHelperGreenStyle(const double &delta) : AuxHelper(delta){};
+
+    double FAux(const VertexPart &vp) const
+    {
+        return (vp.vtype() == VertexType::Phonon) ? auxPh(vp.aux()) : auxValue(vp.spin(), vp.aux());
+    }
+
+    double FAuxBar(const VertexPart &vp) const
+    {
+        return (vp.vtype() == VertexType::Phonon) ? auxPh(vp.aux()) : auxValueBar(vp.spin(), vp.aux());
+    }
+
+    double gamma(const VertexPart &vpI, const VertexPart &vpJ) const // little gamma
+    {
+        const double fsJ = FAux(vpJ);
+        return ((FAux(vpI) - fsJ) / fsJ);
+    }
+};
+
 class VertexBuilder
 {
   public:
@@ -2,8 +2,18 @@
 
 #include "ctmo/Foundations/Logging.hpp"
 #include "ctmo/MonteCarlo/ABC_MonteCarlo.hpp"
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/serialization/vector.hpp>
+#include <cstdio>
+#include <functional>
+#include <algorithm>
+#include <array>
 #include <chrono>
+#include <cmath>
 #include <ctime>
+#include <limits>
+#include <valarray>
 
 namespace MC
 {
@@ -34,11 +44,490 @@ struct Timer
                duration_;
     };
 
+    // Seconds since Start.
+    double Elapsed() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    }
+
+    // Seconds left before End.
+    double Remaining() const
+    { return duration_ - Elapsed(); }
+
 private:
     double duration_{0.0};
     std::chrono::steady_clock::time_point start_;
 };
 
+// Decides when to do the CleanUpdates. Starts every solver.cleanUpdate proposed updates. If solver.cleanUpdateTolerance > 0,
+// the interval is doubled while the drift of the N matrices is well under the tolerance and halved when it is over.
+// A chain that accepted an update with a tiny pivot is cleaned right away.
+struct CleanUpdateSchedule
+{
+    explicit CleanUpdateSchedule(const Json &jjSolver)
+        : cleanUpdate_(jjSolver["cleanUpdate"].get<size_t>()), tolerance_(jjSolver.value("cleanUpdateTolerance", 0.0)),
+          interval_(cleanUpdate_)
+    {
+    }
+
+    template<typename TMarkovChain_t>
+    bool IsDue(const TMarkovChain_t &markovchain) const
+    {
+        return (markovchain.updatesProposed() - lastCleanUpdate_ >= interval_) || markovchain.needsCleanUpdate();
+    }
+
+    void Done(const size_t &updatesProposed, const double &drift)
+    {
+        lastCleanUpdate_ = updatesProposed;
+        maxDrift_ = std::max(maxDrift_, drift);
+        if (tolerance_ <= 0.0)
+        {
+            return;
+        }
+
+        if (drift > tolerance_)
+        {
+            interval_ = std::max(cleanUpdate_ / MAX_FACTOR, std::max(interval_ / 2, size_t(1)));
+        }
+        else if (drift < tolerance_ / 4.0)
+        {
+            interval_ = std::min(cleanUpdate_ * MAX_FACTOR, 2 * interval_);
+        }
+    }
+
+    size_t interval() const
+    { return interval_; }
+
+    double maxDrift() const
+    { return maxDrift_; }
+
+private:
+    static const size_t MAX_FACTOR = 64; // the interval stays between cleanUpdate/MAX_FACTOR and cleanUpdate*MAX_FACTOR
+
+    const size_t cleanUpdate_;
+    const double tolerance_;
+    size_t interval_;
+    size_t lastCleanUpdate_{0};
+    double maxDrift_{0.0};
+};
+
+// Integrated autocorrelation time of a series, by the binning analysis: the values are averaged by pairs, level after level, and
+// once the bins of 2^l values are longer than the correlations, tau = 2^l var_l / (2 var_0) (1/2 for an uncorrelated series).
+class BinningAnalysis
+{
+public:
+    void Add(double value)
+    {
+        for (size_t level = 0;; ++level)
+        {
+            if (level == levels_.size())
+            {
+                levels_.emplace_back();
+            }
+            Level &bins = levels_.at(level);
+            bins.sum += value;
+            bins.sum2 += value * value;
+            ++bins.count;
+            if (!bins.hasPending)
+            {
+                bins.pending = value;
+                bins.hasPending = true;
+                return;
+            }
+            value = 0.5 * (bins.pending + value);
+            bins.hasPending = false;
+        }
+    }
+
+    // The largest estimate over the levels with at least MIN_BINS bins, 0 for a constant series.
+    double AutocorrelationTime() const
+    {
+        if (levels_.empty() || (Variance(levels_.front()) <= 0.0))
+        {
+            return 0.0;
+        }
+
+        const double variance0 = Variance(levels_.front());
+        double tau = 0.5;
+        for (size_t level = 1; (level < levels_.size()) && (levels_.at(level).count >= MIN_BINS); ++level)
+        {
+            tau = std::max(tau, 0.5 * std::ldexp(Variance(levels_.at(level)), static_cast<int>(level)) / variance0);
+        }
+        return tau;
+    }
+
+    size_t count() const
+    { return levels_.empty() ? 0 : levels_.front().count; }
+
+    double Mean() const
+    { return levels_.empty() ? 0.0 : levels_.front().sum / static_cast<double>(levels_.front().count); }
+
+    // Standard error of the mean, sqrt(2 tau var_0 / N), with the autocorrelation time tau above.
+    double StandardError() const
+    {
+        if (count() < 2)
+        {
+            return 0.0;
+        }
+        return std::sqrt(2.0 * AutocorrelationTime() * Variance(levels_.front()) / static_cast<double>(count()));
+    }
+
+    template<class Archive>
+    void serialize(Archive &ar, const unsigned int /*version*/)
+    { ar &levels_; }
+
+private:
+    struct Level
+    {
+        double sum{0.0};
+        double sum2{0.0};
+        size_t count{0};
+        double pending{0.0};
+        bool hasPending{false};
+
+        template<class Archive>
+        void serialize(Archive &ar, const unsigned int /*version*/)
+        { ar &sum &sum2 &count &pending &hasPending; }
+    };
+
+    static double Variance(const Level &bins)
+    {
+        if (bins.count < 2)
+        {
+            return 0.0;
+        }
+        const double mean = bins.sum / static_cast<double>(bins.count);
+        return std::max(0.0, bins.sum2 / static_cast<double>(bins.count) - mean * mean);
+    }
+
+    static const size_t MIN_BINS = 256;
+
+    std::vector<Level> levels_;
+};
+
+// Number of updates proposed between the measurements, updatesMeas. With adaptiveUpdatesMeas, the chain records its expansion
+// order and sign after each update of the second half of the thermalization, and then measures every ceil(2 tau) updates, tau the
+// largest of their integrated autocorrelation times: closer measurements see nearly the same configuration, farther ones throw
+// away statistics. The interval stays between updatesMeas/MAX_FACTOR and updatesMeas*MAX_FACTOR.
+struct MeasurementCadence
+{
+    explicit MeasurementCadence(const Json &jjSolver)
+        : updatesMeas_(jjSolver["updatesMeas"].get<size_t>()), isAdaptive_(jjSolver.value("adaptiveUpdatesMeas", false))
+    {
+    }
+
+    template<typename TMarkovChain_t>
+    void Record(const TMarkovChain_t &markovchain)
+    {
+        order_.Add(static_cast<double>(markovchain.expansionOrder()));
+        sign_.Add(static_cast<double>(markovchain.sign()));
+    }
+
+    // Record during the second half of the thermalization only, the first one is far from equilibrium.
+    bool IsRecording(const Timer &timer, const double &thermalizationDuration) const
+    { return isAdaptive_ && (timer.Elapsed() > 0.5 * thermalizationDuration); }
+
+    double AutocorrelationTime() const
+    { return std::max(order_.AutocorrelationTime(), sign_.AutocorrelationTime()); }
+
+    size_t UpdatesMeas() const
+    {
+        if (!isAdaptive_ || (order_.count() == 0))
+        {
+            return updatesMeas_;
+        }
+        const auto updatesMeas = static_cast<size_t>(std::ceil(2.0 * AutocorrelationTime()));
+        return std::min(updatesMeas_ * MAX_FACTOR, std::max(std::max(updatesMeas_ / MAX_FACTOR, size_t(1)), updatesMeas));
+    }
+
+    // Give the interval to the chain, it keeps it in its checkpoints and saves it in Obs.json.
+    template<typename TMarkovChain_t>
+    void Apply(TMarkovChain_t &markovchain) const
+    {
+        markovchain.SetUpdatesMeas(UpdatesMeas(), AutocorrelationTime());
+        if (isAdaptive_)
+        {
+            Logging::Info("Autocorrelation time of the expansion order and sign = " + std::to_string(AutocorrelationTime()) +
+                          " updates, updatesMeas = " + std::to_string(UpdatesMeas()) + ".");
+        }
+    }
+
+    size_t initialUpdatesMeas() const
+    { return updatesMeas_; }
+
+private:
+    static const size_t MAX_FACTOR = 64;
+
+    const size_t updatesMeas_;
+    const bool isAdaptive_;
+    BinningAnalysis order_;
+    BinningAnalysis sign_;
+};
+
+// Stops the measurements at a target accuracy, monteCarlo.targetError > 0 (default 0: measure for measurementTime). After each
+// measurement the chain gives its sign, and its expansion order, filling and double occupancy weighted by the sign (see
+// ABC_MarkovChain::MeasuredScalars), their means and errors come from a binning analysis. Every monteCarlo.targetCheckTime minutes
+// (default 1), the processes put their means and errors together, and stop once the relative errors of the sign and of k, n and
+// docc (ratios <sign x> / <sign>) are all under targetError. measurementTime stays the upper bound. The decision is taken by all the
+// processes together, at the same check, so that none of them waits for the others in a reduction.
+class AccuracyTarget
+{
+public:
+    explicit AccuracyTarget(const Json &jjMonteCarlo)
+        : targetError_(jjMonteCarlo.value("targetError", 0.0)), interval_(60.0 * jjMonteCarlo.value("targetCheckTime", 1.0))
+    {
+        checkTimer_.Start(interval_);
+    }
+
+    bool IsEnabled() const
+    { return targetError_ > 0.0; }
+
+    // The next check, in targetCheckTime or at the end of the measurement time of timer if it comes first.
+    void Start(const Timer &timer)
+    { checkTimer_.Start(std::min(interval_, timer.Remaining())); }
+
+    template<typename TMarkovChain_t>
+    void Record(const TMarkovChain_t &markovchain)
+    {
+        const std::array<double, N_SCALARS> scalars = markovchain.MeasuredScalars();
+        for (size_t ii = 0; ii < N_SCALARS; ii++)
+        {
+            scalars_.at(ii).Add(scalars.at(ii));
+        }
+    }
+
+    // End of the measurements: at a check, the time of a process is over or the target is reached. Without target, timer.End().
+    // The time is only looked at on the checks, so that all the processes enter the reduction together (see Start).
+    bool IsDone(Timer &timer)
+    {
+        if (!IsEnabled())
+        {
+            return timer.End();
+        }
+        if (!checkTimer_.End())
+        {
+            return false;
+        }
+        const bool isTimeOver = (timer.Remaining() <= 0.0);
+        Start(timer);
+
+        const std::valarray<double> sums = Sums(isTimeOver);
+        const double relativeError = MaxRelativeError(sums);
+        const bool isReached = (sums[1] == 0.0) && (relativeError < targetError_);
+        if (isReached)
+        {
+            Logging::Info("Target error reached, relative error = " + std::to_string(relativeError) + ".");
+        }
+        else
+        {
+            Logging::Debug("Relative error = " + std::to_string(relativeError) + ", target = " + std::to_string(targetError_) + ".");
+        }
+        return isReached || (sums[0] > 0.0);
+    }
+
+    // The largest relative error of the scalars, over the measurements of all the processes.
+    double RelativeError() const
+    { return MaxRelativeError(Sums(false)); }
+
+    // The binning analyses of the measurements, for the checkpoints: after a restart the errors are those of all the measurements.
+    template<class Archive>
+    void serialize(Archive &ar, const unsigned int /*version*/)
+    {
+        for (BinningAnalysis &scalars : scalars_)
+        {
+            ar &scalars;
+        }
+    }
+
+private:
+    // [0]: processes whose time is over, [1]: processes with less than MIN_MEASUREMENTS, then the means and then the squared errors
+    // of the scalars, summed over the processes.
+    std::valarray<double> Sums(const bool &isTimeOver) const
+    {
+        std::valarray<double> sums(0.0, 2 + 2 * N_SCALARS);
+        sums[0] = isTimeOver ? 1.0 : 0.0;
+        sums[1] = (scalars_.front().count() < MIN_MEASUREMENTS) ? 1.0 : 0.0;
+        for (size_t ii = 0; ii < N_SCALARS; ii++)
+        {
+            sums[2 + ii] = scalars_.at(ii).Mean();
+            sums[2 + N_SCALARS + ii] = scalars_.at(ii).StandardError() * scalars_.at(ii).StandardError();
+        }
+#ifdef HAVEMPI
+        mpi::communicator world;
+        sums = mpi::all_reduce(world, sums, std::plus<std::valarray<double>>());
+#endif
+        return sums;
+    }
+
+    // The relative error of the ratio <sign x> / <sign> is taken as the two relative errors added in quadrature. The scalars the chain
+    // does not measure (0 with no error) are skipped.
+    static double MaxRelativeError(const std::valarray<double> &sums)
+    {
+        const auto relative = [&sums](const size_t &ii) {
+            const double mean = sums[2 + ii];
+            const double error2 = sums[2 + N_SCALARS + ii];
+            if (error2 == 0.0)
+            {
+                return 0.0;
+            }
+            return (mean == 0.0) ? std::numeric_limits<double>::infinity() : error2 / (mean * mean);
+        };
+
+        const double relativeSign2 = relative(0);
+        double relativeError2 = relativeSign2;
+        for (size_t ii = 1; ii < N_SCALARS; ii++)
+        {
+            relativeError2 = std::max(relativeError2, relative(ii) + relativeSign2);
+        }
+        return std::sqrt(relativeError2);
+    }
+
+    static const size_t N_SCALARS = 4;
+    static const size_t MIN_MEASUREMENTS = 1000;
+
+    const double targetError_;
+    const double interval_; // seconds
+    Timer checkTimer_;
+    std::array<BinningAnalysis, N_SCALARS> scalars_;
+};
+
+// Warm start, monteCarlo.thermFromConfig: the chains start from the configuration saved by the previous run (Config.dat, ex: the
+// previous iteration of the DMFT loop), N is rebuilt for the new G0, and they thermalize for monteCarlo.thermFromConfigTime
+// minutes only (default: a tenth of the thermalization time). The binary snapshot Config.bin is read first, Config.dat if it is
+// missing or of another beta or cluster (ex: written by an older version). Without a usable configuration, they thermalize as usual.
+struct WarmStart
+{
+    WarmStart(const Json &jjMonteCarlo, const double &thermalizationTime)
+        : isEnabled_(jjMonteCarlo.value("thermFromConfig", false)), thermalizationTime_(thermalizationTime),
+          thermFromConfigTime_(jjMonteCarlo.value("thermFromConfigTime", thermalizationTime / 10.0))
+    {
+    }
+
+    // Loads the configuration in the chains, returns their thermalization time in minutes.
+    template<typename TMarkovChain_t>
+    double Load(const std::vector<TMarkovChain_t *> &chains) const
+    {
+        if (!isEnabled_)
+        {
+            return thermalizationTime_;
+        }
+
+        bool isLoaded = true;
+        for (TMarkovChain_t *chain : chains)
+        {
+            isLoaded = (chain->LoadConfigurationSnapshot(SNAPSHOT_FILE) || chain->LoadConfiguration(CONFIG_FILE)) && isLoaded;
+        }
+        if (!isLoaded)
+        {
+            Logging::Warn("thermFromConfig: could not load " + CONFIG_FILE + ", thermalization from the empty configuration.");
+            return thermalizationTime_;
+        }
+
+        Logging::Info("Thermalization from the configuration of " + CONFIG_FILE + ".");
+        return thermFromConfigTime_;
+    }
+
+private:
+    const std::string CONFIG_FILE = "Config.dat";
+    const std::string SNAPSHOT_FILE = "Config.bin";
+
+    const bool isEnabled_;
+    const double thermalizationTime_;
+    const double thermFromConfigTime_;
+};
+
+// Checkpoints of the measurements of one chain, every monteCarlo.checkpointTime minutes (default 0: no checkpoints). The full state
+// of the chain, its number of measurements and the elapsed measurement time go to checkpoint<rank>_<chain>.bin, written to a
+// temporary file first so that a run killed while writing keeps the previous checkpoint. With ctmo --restart
+// (monteCarlo.restart), the chain reloads it, skips the thermalization and measures for the remaining time only.
+class Checkpoint
+{
+public:
+    Checkpoint(const Json &jjMonteCarlo, const size_t &chainIndex)
+        : interval_(60.0 * jjMonteCarlo.value("checkpointTime", 0.0)), isRestart_(jjMonteCarlo.value("restart", false)),
+          fileName_("checkpoint" + std::to_string(mpiUt::Tools::Rank()) + "_" + std::to_string(chainIndex) + ".bin")
+    {
+        timer_.Start(interval_);
+    }
+
+    // Save if checkpointTime has passed since the last one. With accuracyTarget, its binning analyses are saved after the chain.
+    template<typename TMarkovChain_t>
+    void SaveIfDue(TMarkovChain_t &markovchain, const size_t &NMeas, const double &elapsed,
+                   const AccuracyTarget *accuracyTarget = nullptr)
+    {
+        if ((interval_ <= 0.0) || !timer_.End())
+        {
+            return;
+        }
+
+        const std::string fileNameTmp = fileName_ + ".tmp";
+        {
+            std::ofstream fout(fileNameTmp, std::ios::binary);
+            boost::archive::binary_oarchive ar(fout);
+            const size_t version = VERSION;
+            ar << version << NMeas << elapsed;
+            markovchain.SaveCheckpoint(ar);
+            if (accuracyTarget != nullptr)
+            {
+                ar << *accuracyTarget;
+            }
+        }
+        std::rename(fileNameTmp.c_str(), fileName_.c_str());
+        timer_.Start(interval_);
+    }
+
+    // With --restart, if all the processes have their checkpoint. Else all start from the beginning, so that they stay in step.
+    bool CanRestart() const
+    {
+        if (!isRestart_)
+        {
+            return false;
+        }
+        bool canRestart = std::ifstream(fileName_, std::ios::binary).good();
+#ifdef HAVEMPI
+        mpi::communicator world;
+        canRestart = mpi::all_reduce(world, canRestart, std::logical_and<bool>());
+#endif
+        if (!canRestart)
+        {
+            Logging::Warn("Missing checkpoints to restart from, start from the beginning.");
+        }
+        return canRestart;
+    }
+
+    template<typename TMarkovChain_t>
+    void Load(TMarkovChain_t &markovchain, size_t &NMeas, double &elapsed, AccuracyTarget *accuracyTarget = nullptr) const
+    {
+        std::ifstream fin(fileName_, std::ios::binary);
+        boost::archive::binary_iarchive ar(fin);
+        size_t version = 0;
+        ar >> version;
+        if (version != VERSION)
+        {
+            throw std::runtime_error("The checkpoint " + fileName_ + " is from another version of ctmo.");
+        }
+        ar >> NMeas >> elapsed;
+        markovchain.LoadCheckpoint(ar);
+        if (accuracyTarget != nullptr)
+        {
+            ar >> *accuracyTarget;
+        }
+        Logging::Info("Restart from " + fileName_ + ", after " + std::to_string(elapsed / 60.0) + " minutes of measurements.");
+    }
+
+    // The run finished and saved its results, its checkpoint must not be restarted from.
+    void Remove() const { std::remove(fileName_.c_str()); }
+
+private:
+    // To increase each time the layout of something in the archive changes (ex: the bins of GreenBinning).
+    static const size_t VERSION = 6;
+
+    const double interval_; // seconds
+    const bool isRestart_;
+    const std::string fileName_;
+    Timer timer_;
+};
+
 template<typename TMarkovChain_t>
 class MonteCarlo : public ABC_MonteCarlo
 {
@@ -48,15 +537,15 @@ public:
 #ifdef SLMC
               thermalizationTime_(jj["slmc"]["thermalizationTime"].get<double>()),
               measurementTime_(jj["slmc"]["measurementTime"].get<double>()),
-              updatesMeas_(jj["slmc"]["updatesMeas"].get<size_t>()),
+              cadence_(jj["slmc"]),
 #else
             thermalizationTime_(jj["monteCarlo"]["thermalizationTime"].get<double>()),
             measurementTime_(jj["monteCarlo"]["measurementTime"].get<double>()),
-            updatesMeas_(jj["solver"]["updatesMeas"].get<size_t>()),
+            cadence_(jj["solver"]),
 #endif
 
-              cleanUpdate_(jj["solver"]["cleanUpdate"].get<size_t>()), NMeas_(0), NCleanUpdates_(0),
-              thermFromConfig_(jj["monteCarlo"]["thermFromConfig"].get<bool>())
+              cleanUpdateSchedule_(jj["solver"]), warmStart_(jj["monteCarlo"], thermalizationTime_), checkpoint_(jj["monteCarlo"], 0),
+              accuracyTarget_(jj["monteCarlo"]), NMeas_(0), NCleanUpdates_(0)
     {
     }
 
@@ -72,68 +561,56 @@ public:
 
     void RunMonteCarlo() override
     {
-        Timer timer;
-
-        // if (thermFromConfig_)
-        // {
-        //     // markovchainPtr_->ThermalizeFromConfig();
-        // }
-        // else
-        // {
-
-        Logging::Info("Start Thermalization. ");
-
-        timer.Start(60.0 * thermalizationTime_);
-        while (true)
+        double elapsed = 0.0; // seconds of measurements before the restart
+        if (checkpoint_.CanRestart())
         {
-            markovchainPtr_->DoStep();
-            if (markovchainPtr_->updatesProposed() % updatesMeas_ == 0)
-            {
-                if (timer.End())
-                {
-                    break;
-                }
-                ++NMeas_;
-            }
-
-            if (markovchainPtr_->updatesProposed() % cleanUpdate_ == 0)
-            {
-                markovchainPtr_->CleanUpdate();
-            }
+            checkpoint_.Load(*markovchainPtr_, NMeas_, elapsed, &accuracyTarget_);
+        }
+        else
+        {
+            Thermalize();
+            NMeas_ = 0;
         }
 
-        markovchainPtr_->SaveTherm();
-        Logging::Info("End Thermalization.: ");
-        // }
-
-        NMeas_ = 0;
-        timer.Start(60.0 * measurementTime_);
+        const size_t updatesMeas = markovchainPtr_->updatesMeas();
+        Timer timer;
+        timer.Start(60.0 * measurementTime_ - elapsed);
+        accuracyTarget_.Start(timer);
         Logging::Info("Start Measurements. ");
 
         while (true)
         {
             markovchainPtr_->DoStep(); // One simple sweep
 
-            if (markovchainPtr_->updatesProposed() % updatesMeas_ == 0)
+            if (markovchainPtr_->updatesProposed() % updatesMeas == 0)
             {
-                if (timer.End())
+                if (accuracyTarget_.IsDone(timer))
                 {
                     break;
                 }
                 markovchainPtr_->Measure();
                 NMeas_++;
+                if (accuracyTarget_.IsEnabled())
+                {
+                    accuracyTarget_.Record(*markovchainPtr_);
+                }
+                checkpoint_.SaveIfDue(*markovchainPtr_, NMeas_, elapsed + timer.Elapsed(), &accuracyTarget_);
             }
 
-            if (markovchainPtr_->updatesProposed() % cleanUpdate_ == 0)
+            if (cleanUpdateSchedule_.IsDue(*markovchainPtr_))
             {
                 markovchainPtr_->CleanUpdate();
+                cleanUpdateSchedule_.Done(markovchainPtr_->updatesProposed(), markovchainPtr_->cleanUpdateDrift());
                 ++NCleanUpdates_;
             }
         }
 
         Logging::Debug("NCleanUpdates = " + std::to_string(NCleanUpdates_));
+        Logging::Debug("CleanUpdate interval = " + std::to_string(cleanUpdateSchedule_.interval()) +
+                       ", max drift = " + std::to_string(cleanUpdateSchedule_.maxDrift()));
         Logging::Info("End Measurements.");
         markovchainPtr_->SaveMeas();
+        checkpoint_.Remove();
     }
 
     // Getters
@@ -147,15 +624,56 @@ public:
     { return markovchainPtr_->updatesProposed(); }
 
 private:
+    void Thermalize()
+    {
+        Timer timer;
+        const double thermalizationTime = warmStart_.Load(std::vector<TMarkovChain_t *>{markovchainPtr_.get()});
+
+        Logging::Info("Start Thermalization. ");
+
+        timer.Start(60.0 * thermalizationTime);
+        bool isRecording = false;
+        while (true)
+        {
+            markovchainPtr_->DoStep();
+            if (isRecording)
+            {
+                cadence_.Record(*markovchainPtr_);
+            }
+
+            if (markovchainPtr_->updatesProposed() % cadence_.initialUpdatesMeas() == 0)
+            {
+                if (timer.End())
+                {
+                    break;
+                }
+                isRecording = cadence_.IsRecording(timer, 60.0 * thermalizationTime);
+                ++NMeas_;
+            }
+
+            if (cleanUpdateSchedule_.IsDue(*markovchainPtr_))
+            {
+                markovchainPtr_->CleanUpdate();
+                cleanUpdateSchedule_.Done(markovchainPtr_->updatesProposed(), markovchainPtr_->cleanUpdateDrift());
+            }
+        }
+
+        markovchainPtr_->SaveTherm();
+        Logging::Info("End Thermalization.: ");
+        cadence_.Apply(*markovchainPtr_);
+    }
+
     // attributes
     const std::shared_ptr<TMarkovChain_t> markovchainPtr_;
     const double thermalizationTime_;
     const double measurementTime_;
-    const size_t updatesMeas_;
-    const size_t cleanUpdate_;
+    MeasurementCadence cadence_;
+    CleanUpdateSchedule cleanUpdateSchedule_;
+    const WarmStart warmStart_;
+    Checkpoint checkpoint_;
+    AccuracyTarget accuracyTarget_;
 
     size_t NMeas_;
     size_t NCleanUpdates_;
-    bool thermFromConfig_;
 };
 } // namespace MC
@@ -1,11 +1,32 @@
 #pragma once
 
 #include "ctmo/MonteCarlo/MonteCarlo.hpp"
+#include "ctmo/MonteCarlo/MonteCarloThreads.hpp"
+#include "ctmo/MonteCarlo/MonteCarloTempering.hpp"
 #include "ctmo/ImpuritySolver/MarkovChain.hpp"
 
 namespace MC
 {
 
+template <typename TMarkovChain_t> std::unique_ptr<ABC_MonteCarlo> BuildMonteCarlo(const Json &jjSim, const size_t &seed)
+{
+    if (mpiUt::ReplicaLadder(jjSim).IsEnabled())
+    {
+        return std::make_unique<MC::MonteCarloTempering<TMarkovChain_t>>(jjSim, seed);
+    }
+
+    const auto nThreads = jjSim["solver"].value("nThreads", size_t(1));
+    if (nThreads > 1)
+    {
+        return std::make_unique<MC::MonteCarloThreads<TMarkovChain_t>>(jjSim, seed, nThreads);
+    }
+
+    return std::make_unique<MC::MonteCarlo<TMarkovChain_t>>(std::make_shared<TMarkovChain_t>(jjSim, seed), jjSim);
+}
+
+// The chain is instantiated at runtime for the precision of the N matrices only. AFM and SLMC stay build flags since they change
+// the data layout of ISDataCT, of the observables and of the results, and isOneOrbitalOptimized is a branch once per removal or
+// flip, outside of the loops over the vertices.
 std::unique_ptr<ABC_MonteCarlo> MonteCarloBuilder(const Json &jjSim, const size_t &seed)
 {
 #ifdef HAVEMPI
@@ -14,7 +35,6 @@ std::unique_ptr<ABC_MonteCarlo> MonteCarloBuilder(const Json &jjSim, const size_
 #endif
 
     using Model_t = Models::ABC_Model_2D;
-    using MarkovInt_t = Markov::MarkovChain;
 
     // Init a dummy model just to be sure that all files are present:
     if (mpiUt::Tools::Rank() == mpiUt::Tools::master)
@@ -25,7 +45,11 @@ std::unique_ptr<ABC_MonteCarlo> MonteCarloBuilder(const Json &jjSim, const size_
     world.barrier();
 #endif
 
-    return std::make_unique<MC::MonteCarlo<MarkovInt_t>>(std::make_shared<MarkovInt_t>(jjSim, seed), jjSim);
+    if (jjSim["solver"].value("mixedPrecision", false))
+    {
+        return BuildMonteCarlo<Markov::MarkovChainT<Markov::AuxHelper_t, float>>(jjSim, seed);
+    }
+    return BuildMonteCarlo<Markov::MarkovChain>(jjSim, seed);
 }
 
 } // namespace MC
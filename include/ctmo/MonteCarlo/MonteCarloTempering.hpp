@@ -0,0 +1,267 @@
+#pragma once
+
+#include "ctmo/MonteCarlo/MonteCarlo.hpp"
+#include <functional>
+
+namespace MC
+{
+
+// Replica exchange (parallel tempering) on U. solver.temperingU is a ladder of U containing model.U, the processes are split in
+// groups of temperingU.size() consecutive ranks with one replica per U (see mpiUt::ReplicaLadder). Every solver.temperingInterval
+// updates, neighbour replicas of a group propose to swap their configurations, alternately the pairs (0, 1), (2, 3), ... and
+// (1, 2), (3, 4), ..., accepted with probability min(1, W_a(C_b) W_b(C_a) / (W_a(C_a) W_b(C_b))). Only the replicas at model.U
+// measure, the ones at smaller U help them to leave the configurations where the chain gets stuck at large U.
+template <typename TMarkovChain_t> class MonteCarloTempering : public ABC_MonteCarlo
+{
+  public:
+    MonteCarloTempering(const Json &jj, const size_t &seed)
+        : ladder_(jj), markovchainPtr_(std::make_shared<TMarkovChain_t>(ladder_.ReplicaSimulation(jj), seed)),
+          thermalizationTime_(jj["monteCarlo"]["thermalizationTime"].get<double>()),
+          measurementTime_(jj["monteCarlo"]["measurementTime"].get<double>()), cadence_(jj["solver"]),
+          temperingInterval_(jj["solver"].value("temperingInterval", jj["solver"]["cleanUpdate"].get<size_t>())),
+          cleanUpdateSchedule_(jj["solver"]), warmStart_(jj["monteCarlo"], thermalizationTime_), checkpoint_(jj["monteCarlo"], 0),
+          rng_(seed + 1), urng_(rng_, Utilities::UniformDistribution_t(0.0, 1.0))
+    {
+#ifdef SLMC
+        throw std::runtime_error("The replica exchange (solver.temperingU) is not done for SLMC.");
+#endif
+#ifdef HAVEMPI
+        mpi::communicator world;
+        group_ = world.split(static_cast<int>(ladder_.Group()));
+        assert(static_cast<size_t>(group_.rank()) == ladder_.Index());
+#else
+        throw std::runtime_error("The replica exchange (solver.temperingU) needs mpi.");
+#endif
+        if (temperingInterval_ == 0)
+        {
+            throw std::runtime_error("solver.temperingInterval should be > 0.");
+        }
+        if (AccuracyTarget(jj["monteCarlo"]).IsEnabled())
+        {
+            Logging::Warn("monteCarlo.targetError is not done for the replica exchange, it measures for measurementTime.");
+        }
+        Logging::Info("Replica exchange on " + std::to_string(ladder_.size()) + " values of U, every " +
+                      std::to_string(temperingInterval_) + " updates.");
+    }
+
+    MonteCarloTempering(const MonteCarloTempering &monteCarlo) = delete;
+    MonteCarloTempering(MonteCarloTempering &&monteCarlo) = delete;
+    MonteCarloTempering &operator=(const MonteCarloTempering &monteCarlo) = delete;
+    MonteCarloTempering &operator=(MonteCarloTempering &&monteCarlo) = delete;
+
+    ~MonteCarloTempering() override = default;
+
+    void RunMonteCarlo() override
+    {
+        if (checkpoint_.CanRestart())
+        {
+            checkpoint_.Load(*markovchainPtr_, NMeas_, elapsed_);
+        }
+        else
+        {
+            const double thermalizationTime = warmStart_.Load(std::vector<TMarkovChain_t *>{markovchainPtr_.get()});
+            Logging::Info("Start Thermalization. ");
+            Run(60.0 * thermalizationTime, false);
+            markovchainPtr_->SaveTherm();
+            Logging::Info("End Thermalization.: ");
+            cadence_.Apply(*markovchainPtr_);
+            NMeas_ = 0;
+        }
+
+        swapStats_ = {0, 0};
+        Logging::Info("Start Measurements. ");
+        Run(60.0 * measurementTime_ - elapsed_, true);
+        Logging::Debug("NCleanUpdates = " + std::to_string(NCleanUpdates_));
+        Logging::Info("End Measurements.");
+
+        SaveSwapStats();
+        if (ladder_.IsTarget())
+        {
+            markovchainPtr_->SaveMeas();
+        }
+        else
+        {
+            markovchainPtr_->SaveMeasNoResult();
+        }
+        // SaveMeas writes Config.dat and Config.bin on the world master only, which is not a target replica if model.U is not the
+        // first U of the ladder.
+        if (ladder_.IsFirstTarget() && (mpiUt::Tools::Rank() != mpiUt::Tools::master))
+        {
+            markovchainPtr_->SaveConfigurationFiles();
+        }
+        checkpoint_.Remove();
+    }
+
+    // Getters
+    size_t NMeas() const { return NMeas_; }
+
+    size_t NCleanUpdates() const { return NCleanUpdates_; }
+
+  private:
+    // The replicas of a group stop together, when the time of one of them is over, so that none waits for a swap forever.
+    // Every replica checkpoints its own chain during the measurements, the swap rounds start again from 0 on all of them at restart.
+    void Run(const double &duration, const bool &isMeasurement)
+    {
+        const bool measure = isMeasurement && ladder_.IsTarget();
+        const size_t updatesMeas = markovchainPtr_->updatesMeas();
+        Timer timer;
+        timer.Start(duration);
+        bool isRecording = false;
+        while (true)
+        {
+            markovchainPtr_->DoStep();
+            if (isRecording)
+            {
+                cadence_.Record(*markovchainPtr_);
+            }
+
+            if (measure && (markovchainPtr_->updatesProposed() % updatesMeas == 0))
+            {
+                markovchainPtr_->Measure();
+                ++NMeas_;
+            }
+
+            if (markovchainPtr_->updatesProposed() % temperingInterval_ == 0)
+            {
+                if (IsGroupDone(timer))
+                {
+                    break;
+                }
+                isRecording = !isMeasurement && cadence_.IsRecording(timer, duration);
+                ProposeSwap();
+                if (isMeasurement)
+                {
+                    checkpoint_.SaveIfDue(*markovchainPtr_, NMeas_, elapsed_ + timer.Elapsed());
+                }
+            }
+
+            if (cleanUpdateSchedule_.IsDue(*markovchainPtr_))
+            {
+                markovchainPtr_->CleanUpdate();
+                cleanUpdateSchedule_.Done(markovchainPtr_->updatesProposed(), markovchainPtr_->cleanUpdateDrift());
+                ++NCleanUpdates_;
+            }
+        }
+    }
+
+    bool IsGroupDone(Timer &timer) const
+    {
+        bool isDone = timer.End();
+#ifdef HAVEMPI
+        isDone = mpi::all_reduce(group_, isDone, std::logical_or<bool>());
+#endif
+        return isDone;
+    }
+
+    // Swap proposal with the neighbour replica of this round, if there is one. Only the configurations are sent, each replica
+    // rebuilds its N matrices. The lower replica of the pair draws the decision.
+    void ProposeSwap()
+    {
+#ifdef HAVEMPI
+        const int index = group_.rank();
+        const bool isLower = ((index % 2) == static_cast<int>(round_ % 2));
+        const int partner = isLower ? index + 1 : index - 1;
+        ++round_;
+        if ((partner < 0) || (partner >= group_.size()))
+        {
+            return;
+        }
+
+        // The clean update gives the exact weight of the current configuration, and counts as a scheduled one.
+        markovchainPtr_->CleanUpdate();
+        cleanUpdateSchedule_.Done(markovchainPtr_->updatesProposed(), markovchainPtr_->cleanUpdateDrift());
+        ++NCleanUpdates_;
+
+        const std::vector<double> configuration = markovchainPtr_->Configuration();
+        const double logWeight = markovchainPtr_->LogWeight();
+        std::vector<double> configurationPartner;
+        if (isLower)
+        {
+            group_.send(partner, TAG_CONFIGURATION, configuration);
+            group_.recv(partner, TAG_CONFIGURATION, configurationPartner);
+        }
+        else
+        {
+            group_.recv(partner, TAG_CONFIGURATION, configurationPartner);
+            group_.send(partner, TAG_CONFIGURATION, configuration);
+        }
+
+        markovchainPtr_->SetConfiguration(configurationPartner);
+        const double deltaLogWeight = markovchainPtr_->LogWeight() - logWeight;
+
+        bool isAccepted = false;
+        if (isLower)
+        {
+            double deltaLogWeightPartner = 0.0;
+            group_.recv(partner, TAG_DECISION, deltaLogWeightPartner);
+            isAccepted = (urng_() < std::exp(deltaLogWeight + deltaLogWeightPartner));
+            group_.send(partner, TAG_DECISION, isAccepted);
+            swapStats_[0]++;
+            if (isAccepted)
+            {
+                swapStats_[1]++;
+            }
+        }
+        else
+        {
+            group_.send(partner, TAG_DECISION, deltaLogWeight);
+            group_.recv(partner, TAG_DECISION, isAccepted);
+        }
+
+        if (!isAccepted)
+        {
+            markovchainPtr_->SetConfiguration(configuration);
+        }
+#endif
+    }
+
+    // Log the swaps proposed and accepted between the replicas i and i + 1 of the ladder, summed over the groups.
+    void SaveSwapStats() const
+    {
+#ifdef HAVEMPI
+        mpi::communicator world;
+        std::vector<std::valarray<size_t>> swapStatsVec;
+        mpi::gather(world, swapStats_, swapStatsVec, mpiUt::Tools::master);
+        if (mpiUt::Tools::Rank() == mpiUt::Tools::master)
+        {
+            Json jjout;
+            for (size_t ii = 0; ii + 1 < ladder_.size(); ii++)
+            {
+                std::valarray<size_t> swapStatsPair = {0, 0};
+                for (size_t rank = ii; rank < swapStatsVec.size(); rank += ladder_.size())
+                {
+                    swapStatsPair += swapStatsVec.at(rank);
+                }
+                jjout[std::to_string(ii) + "-" + std::to_string(ii + 1)] = {{"Proposed", swapStatsPair[0]}, {"Accepted", swapStatsPair[1]}};
+            }
+            Logging::Info("\n\n Statistics Replica Exchange:\n" + jjout.dump(4) + "\n\n");
+        }
+#endif
+    }
+
+    static const int TAG_CONFIGURATION = 0;
+    static const int TAG_DECISION = 1;
+
+    const mpiUt::ReplicaLadder ladder_;
+    const std::shared_ptr<TMarkovChain_t> markovchainPtr_;
+    const double thermalizationTime_;
+    const double measurementTime_;
+    MeasurementCadence cadence_;
+    const size_t temperingInterval_;
+    CleanUpdateSchedule cleanUpdateSchedule_;
+    const WarmStart warmStart_;
+    Checkpoint checkpoint_;
+
+    Utilities::EngineTypeMt19937_t rng_; // for the swap decisions, not to shift the random numbers of the chain
+    Utilities::UniformRngMt19937_t urng_;
+#ifdef HAVEMPI
+    mpi::communicator group_;
+#endif
+    size_t round_{0};
+    std::valarray<size_t> swapStats_{0, 0}; // [0] = number of swaps proposed, [1] = accepted, by the lower replica of the pair
+
+    size_t NMeas_{0};
+    size_t NCleanUpdates_{0};
+    double elapsed_{0.0}; // seconds of measurements before the restart
+};
+} // namespace MC
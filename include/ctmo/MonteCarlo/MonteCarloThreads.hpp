@@ -0,0 +1,216 @@
+#pragma once
+
+#include "ctmo/MonteCarlo/MonteCarlo.hpp"
+#include <exception>
+#include <numeric>
+#include <thread>
+
+namespace MC
+{
+
+// Many independent markov chains in the same process, each on its own thread. The chains share the model and the G0 tables,
+// the measurements are kept per chain and are reduced when saving.
+template <typename TMarkovChain_t> class MonteCarloThreads : public ABC_MonteCarlo
+{
+  public:
+    MonteCarloThreads(const Json &jj, const size_t &seed, const size_t &nThreads)
+        :
+#ifdef SLMC
+          thermalizationTime_(jj["slmc"]["thermalizationTime"].get<double>()),
+          measurementTime_(jj["slmc"]["measurementTime"].get<double>()), cadences_(nThreads, MeasurementCadence(jj["slmc"])),
+#else
+          thermalizationTime_(jj["monteCarlo"]["thermalizationTime"].get<double>()),
+          measurementTime_(jj["monteCarlo"]["measurementTime"].get<double>()), cadences_(nThreads, MeasurementCadence(jj["solver"])),
+#endif
+          cleanUpdateSchedules_(nThreads, CleanUpdateSchedule(jj["solver"])), warmStart_(jj["monteCarlo"], thermalizationTime_),
+          NMeas_(nThreads, 0), NCleanUpdates_(nThreads, 0), elapsed_(nThreads, 0.0)
+    {
+        assert(nThreads >= 1);
+        markovchainPtrs_.push_back(std::make_shared<TMarkovChain_t>(jj, seed));
+        for (size_t ii = 1; ii < nThreads; ii++)
+        {
+            markovchainPtrs_.push_back(std::make_shared<TMarkovChain_t>(jj, seed + SEED_SHIFT * ii, *markovchainPtrs_.at(0)));
+        }
+        for (size_t ii = 0; ii < nThreads; ii++)
+        {
+            checkpoints_.emplace_back(jj["monteCarlo"], ii);
+        }
+        if (AccuracyTarget(jj["monteCarlo"]).IsEnabled())
+        {
+            Logging::Warn("monteCarlo.targetError is for one chain per process, the chains on threads measure for measurementTime.");
+        }
+        Logging::Info("Running " + std::to_string(nThreads) + " markov chains on threads.");
+    }
+
+    MonteCarloThreads(const MonteCarloThreads &monteCarlo) = delete;
+    MonteCarloThreads(MonteCarloThreads &&monteCarlo) = delete;
+    MonteCarloThreads &operator=(const MonteCarloThreads &monteCarlo) = delete;
+    MonteCarloThreads &operator=(MonteCarloThreads &&monteCarlo) = delete;
+
+    ~MonteCarloThreads() override = default;
+
+    void RunMonteCarlo() override
+    {
+        std::vector<typename TMarkovChain_t::Base_t *> chains;
+        for (const auto &markovchainPtr : markovchainPtrs_)
+        {
+            chains.push_back(markovchainPtr.get());
+        }
+
+        // Every CanRestart is called, they talk to mpi.
+        bool canRestart = true;
+        for (const Checkpoint &checkpoint : checkpoints_)
+        {
+            canRestart = checkpoint.CanRestart() && canRestart;
+        }
+
+        if (canRestart)
+        {
+            for (size_t ii = 0; ii < checkpoints_.size(); ii++)
+            {
+                checkpoints_.at(ii).Load(*markovchainPtrs_.at(ii), NMeas_.at(ii), elapsed_.at(ii));
+            }
+        }
+        else
+        {
+            const double thermalizationTime = warmStart_.Load(chains);
+            Logging::Info("Start Thermalization. ");
+            RunThreads([this, &thermalizationTime](const size_t &ii) { Thermalize(ii, thermalizationTime); });
+            TMarkovChain_t::SaveTherm(chains);
+            Logging::Info("End Thermalization.: ");
+            for (size_t ii = 0; ii < cadences_.size(); ii++)
+            {
+                cadences_.at(ii).Apply(*markovchainPtrs_.at(ii));
+            }
+        }
+
+        Logging::Info("Start Measurements. ");
+        RunThreads([this](const size_t &ii) { Measure(ii); });
+        Logging::Debug("NCleanUpdates = " + std::to_string(NCleanUpdates()));
+        Logging::Info("End Measurements.");
+
+        TMarkovChain_t::SaveMeas(chains);
+        for (const Checkpoint &checkpoint : checkpoints_)
+        {
+            checkpoint.Remove();
+        }
+    }
+
+    // Getters
+    size_t NMeas() const { return std::accumulate(NMeas_.begin(), NMeas_.end(), size_t(0)); }
+
+    size_t NCleanUpdates() const { return std::accumulate(NCleanUpdates_.begin(), NCleanUpdates_.end(), size_t(0)); }
+
+  private:
+    // Only the main thread logs and talks to mpi, the chains only do their steps in the threads.
+    template <typename TFunction_t> void RunThreads(const TFunction_t &function)
+    {
+        std::vector<std::thread> threads;
+        std::vector<std::exception_ptr> exceptions(markovchainPtrs_.size());
+        for (size_t ii = 0; ii < markovchainPtrs_.size(); ii++)
+        {
+            threads.emplace_back([&function, &exceptions, ii]() {
+                try
+                {
+                    function(ii);
+                }
+                catch (...)
+                {
+                    exceptions.at(ii) = std::current_exception();
+                }
+            });
+        }
+
+        for (auto &thread : threads)
+        {
+            thread.join();
+        }
+
+        for (const auto &exception : exceptions)
+        {
+            if (exception)
+            {
+                std::rethrow_exception(exception);
+            }
+        }
+    }
+
+    void Thermalize(const size_t &ii, const double &thermalizationTime)
+    {
+        TMarkovChain_t &markovchain = *markovchainPtrs_.at(ii);
+        CleanUpdateSchedule &cleanUpdateSchedule = cleanUpdateSchedules_.at(ii);
+        MeasurementCadence &cadence = cadences_.at(ii);
+        Timer timer;
+        timer.Start(60.0 * thermalizationTime);
+        bool isRecording = false;
+        while (true)
+        {
+            markovchain.DoStep();
+            if (isRecording)
+            {
+                cadence.Record(markovchain);
+            }
+
+            if (markovchain.updatesProposed() % cadence.initialUpdatesMeas() == 0)
+            {
+                if (timer.End())
+                {
+                    break;
+                }
+                isRecording = cadence.IsRecording(timer, 60.0 * thermalizationTime);
+            }
+
+            if (cleanUpdateSchedule.IsDue(markovchain))
+            {
+                markovchain.CleanUpdate();
+                cleanUpdateSchedule.Done(markovchain.updatesProposed(), markovchain.cleanUpdateDrift());
+            }
+        }
+    }
+
+    void Measure(const size_t &ii)
+    {
+        TMarkovChain_t &markovchain = *markovchainPtrs_.at(ii);
+        CleanUpdateSchedule &cleanUpdateSchedule = cleanUpdateSchedules_.at(ii);
+        const size_t updatesMeas = markovchain.updatesMeas();
+        Timer timer;
+        timer.Start(60.0 * measurementTime_ - elapsed_.at(ii));
+        while (true)
+        {
+            markovchain.DoStep();
+
+            if (markovchain.updatesProposed() % updatesMeas == 0)
+            {
+                if (timer.End())
+                {
+                    break;
+                }
+                markovchain.Measure();
+                NMeas_.at(ii)++;
+                checkpoints_.at(ii).SaveIfDue(markovchain, NMeas_.at(ii), elapsed_.at(ii) + timer.Elapsed());
+            }
+
+            if (cleanUpdateSchedule.IsDue(markovchain))
+            {
+                markovchain.CleanUpdate();
+                cleanUpdateSchedule.Done(markovchain.updatesProposed(), markovchain.cleanUpdateDrift());
+                NCleanUpdates_.at(ii)++;
+            }
+        }
+    }
+
+    static const size_t SEED_SHIFT = 100003;
+
+    std::vector<std::shared_ptr<TMarkovChain_t>> markovchainPtrs_;
+    const double thermalizationTime_;
+    const double measurementTime_;
+    std::vector<MeasurementCadence> cadences_;
+    std::vector<CleanUpdateSchedule> cleanUpdateSchedules_;
+    const WarmStart warmStart_;
+    std::vector<Checkpoint> checkpoints_;
+
+    std::vector<size_t> NMeas_; // one per thread, no sharing between the threads
+    std::vector<size_t> NCleanUpdates_;
+    std::vector<double> elapsed_; // seconds of measurements before the restart
+};
+} // namespace MC
@@ -35,6 +35,7 @@ int main(int argc, char **argv)
     std::ifstream fin(fnameParams);
     fin >> jjSim;
     fin.close();
+    jjSim["monteCarlo"]["restart"] = cmdInfo.restart();
 
     Logging::Init(jjSim["logging"]);
     Logging::Info(PrintVersion::GetVersion());
@@ -81,6 +82,7 @@ int main(int argc, char **argv)
 
         std::ifstream fin(fnameParams);
         fin >> jjSim;
+        jjSim["monteCarlo"]["restart"] = cmdInfo.restart();
         jjSimStr = jjSim.dump();
         fin.close();
     }
@@ -2,6 +2,8 @@
 #include <gtest/gtest.h>
 
 #include "ctmo/ImpuritySolver/GreenBinning.hpp"
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
 
 using Model_t = Models::ABC_Model_2D;
 using IOModel_t = IO::Base_IOModel;
@@ -31,6 +33,89 @@ GreenBinning_t BuildGreenBinning() // for Square2x2
 
 TEST(GreenBinningTests, Init) { GreenBinning_t greenBinning = BuildGreenBinning(); }
 
+// The FFT of the bins of FinalizeGreenBinning against the direct sum over the bins, for random bins (loaded as from a checkpoint).
+TEST(GreenBinningTests, FinalizeFFT)
+{
+    std::ifstream fin(FNAME);
+    Json jj;
+    fin >> jj;
+    fin.close();
+    jj["solver"]["nThreads"] = 3;
+    std::shared_ptr<Model_t> modelPtr(new Model_t(jj));
+    std::shared_ptr<ISDataCT_t> dataCT(new ISDataCT_t(jj, modelPtr));
+    const std::shared_ptr<IOModel_t> ioModelPtr = modelPtr->ioModelPtr();
+    const size_t NOrb = jj["model"]["nOrb"].get<size_t>();
+    const size_t LL = ioModelPtr->GetNIndepSuperSites(NOrb);
+    const size_t NBin = Markov::Obs::N_BIN_TAU;
+
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+    std::vector<std::vector<std::vector<double>>> bins(4, std::vector<std::vector<double>>(LL, std::vector<double>(NBin)));
+    for (auto &moment : bins)
+    {
+        for (auto &bin : moment)
+        {
+            std::generate(bin.begin(), bin.end(), [&]() { return dist(rng); });
+        }
+    }
+
+    std::vector<double> binsInterleaved(LL * NBin * 4);
+    for (size_t ll = 0; ll < LL; ++ll)
+    {
+        for (size_t ii = 0; ii < NBin; ii++)
+        {
+            for (size_t kk = 0; kk < 4; kk++)
+            {
+                binsInterleaved.at((ll * NBin + ii) * 4 + kk) = bins[kk][ll][ii];
+            }
+        }
+    }
+
+    std::stringstream ss;
+    {
+        boost::archive::binary_oarchive oa(ss);
+        oa << binsInterleaved;
+    }
+    GreenBinning_t greenBinning(dataCT, jj, FermionSpin_t::Up);
+    {
+        boost::archive::binary_iarchive ia(ss);
+        ia >> greenBinning;
+    }
+
+    const double signMeas = 0.8;
+    const size_t NMeas = 7;
+    const ClusterCubeCD_t greenCube = greenBinning.FinalizeGreenBinning(signMeas, NMeas);
+
+    const double beta = modelPtr->beta();
+    const double dTau = beta / NBin;
+    const ClusterCubeCD_t &green0Cube = modelPtr->greenCluster0MatUp().data();
+    ASSERT_GT(greenCube.n_slices, 0);
+    for (size_t n = 0; n < greenCube.n_slices; n += 7)
+    {
+        const double omega_n = M_PI * (2.0 * n + 1.0) / beta;
+        const cd_t iomega_n(0.0, omega_n);
+        const double lambda =
+            2.0 * std::sin(omega_n * dTau / 2.0) / (dTau * omega_n * (1.0 - omega_n * omega_n * dTau * dTau / 24.0) * NMeas);
+        SiteVectorCD_t indepM(LL);
+        for (size_t ll = 0; ll < LL; ++ll)
+        {
+            const size_t llSite = ll % ioModelPtr->indepSites().size();
+            const double nAssociated = static_cast<double>(ioModelPtr->nOfAssociatedSites().at(llSite));
+            cd_t sum = 0.0;
+            for (size_t ii = 0; ii < NBin; ii++)
+            {
+                const cd_t coeff = lambda * std::exp(iomega_n * dTau * (ii + 0.5)) / nAssociated;
+                sum += coeff * (bins[0][ll][ii] + bins[1][ll][ii] * iomega_n + bins[2][ll][ii] * iomega_n * iomega_n / 2.0 +
+                                bins[3][ll][ii] * iomega_n * iomega_n * iomega_n / 6.0);
+            }
+            indepM(ll) = sum;
+        }
+        const ClusterMatrixCD_t &green0 = green0Cube.slice(n);
+        const ClusterMatrixCD_t expected = green0 - green0 * ioModelPtr->IndepToFull(indepM, NOrb) * green0 / (beta * signMeas);
+        ASSERT_LT(arma::abs(greenCube.slice(n) - expected).max(), 1e-10 * arma::abs(expected).max());
+    }
+}
+
 int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,66 @@
+
+#include <gtest/gtest.h>
+
+#include "ctmo/ImpuritySolver/GreenLegendre.hpp"
+
+using Model_t = Models::ABC_Model_2D;
+using GreenLegendre_t = Markov::Obs::GreenLegendre;
+using ISDataCT_t = Markov::Obs::ISDataCT;
+
+const double DELTA = 1e-11;
+const std::string FNAME = "../../test/data/cdmft_square2x2/params1.json";
+
+Json ReadParams(const size_t &nLegendre)
+{
+    std::ifstream fin(FNAME);
+    Json jj;
+    fin >> jj;
+    fin.close();
+    jj["solver"]["nLegendre"] = nLegendre;
+    return jj;
+}
+
+TEST(GreenLegendreTests, Init)
+{
+    const Json jj = ReadParams(40);
+    std::shared_ptr<Model_t> modelPtr(new Model_t(jj));
+    std::shared_ptr<ISDataCT_t> dataCT(new ISDataCT_t(jj, modelPtr));
+
+    ASSERT_EQ(GreenLegendre_t::NLegendre(jj), 40);
+    GreenLegendre_t greenLegendre(dataCT, jj, FermionSpin_t::Up);
+    ASSERT_THROW(GreenLegendre_t(dataCT, ReadParams(1), FermionSpin_t::Up), std::runtime_error);
+}
+
+// A single contribution at tau0 has the coefficients sqrt(2l + 1) P_l(x0), its transform is exp(iwn tau0) for the frequencies
+// below the cutoff of the series.
+TEST(GreenLegendreTests, MatsubaraTransform)
+{
+    const double beta = 5.0;
+    const size_t NMat = 6;
+    const size_t NLegendre = 50;
+    const ClusterMatrixCD_t transform = GreenLegendre_t::MatsubaraTransform(NMat, NLegendre);
+    ASSERT_EQ(transform.n_rows, NMat);
+    ASSERT_EQ(transform.n_cols, NLegendre);
+
+    for (const double tau0 : {0.0, 0.3, 2.5, 4.9})
+    {
+        const double x0 = 2.0 * tau0 / beta - 1.0;
+        for (size_t n = 0; n < NMat; ++n)
+        {
+            cd_t result = 0.0;
+            for (size_t ll = 0; ll < NLegendre; ++ll)
+            {
+                result += transform(n, ll) * std::sqrt(2.0 * ll + 1.0) * std::legendre(static_cast<unsigned>(ll), x0);
+            }
+            const cd_t expected = std::exp(cd_t(0.0, (2.0 * n + 1.0) * M_PI / beta * tau0));
+            ASSERT_NEAR(result.real(), expected.real(), DELTA);
+            ASSERT_NEAR(result.imag(), expected.imag(), DELTA);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
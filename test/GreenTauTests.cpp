@@ -39,7 +39,7 @@ Json BuildJson()
     return tJson;
 }
 
-GreenMat::GreenCluster0Mat BuildGreenMat()
+GreenMat::GreenCluster0Mat BuildGreenMat(const size_t &nMats = 30)
 {
     ClusterMatrixCD_t tLoc(4, 4);
     ClusterMatrixCD_t fmhyb(4, 4);
@@ -47,7 +47,7 @@ GreenMat::GreenCluster0Mat BuildGreenMat()
     fmhyb.zeros();
 
     tLoc(0, 1) = tLoc(1, 0) = tLoc(1, 3) = tLoc(3, 1) = tLoc(2, 3) = tLoc(3, 2) = tLoc(0, 2) = tLoc(2, 0) = t;
-    ClusterCubeCD_t hybdata(4, 4, 30);
+    ClusterCubeCD_t hybdata(4, 4, nMats);
     hybdata.zeros();
 
     GreenMat::HybridizationMat hybMat(hybdata, fmhyb); // HYbridation nulle
@@ -243,6 +243,152 @@ TEST(GreenTauTests, Operator)
     }
 }
 
+TEST(GreenTauTests, CubicInterpolation)
+{
+    Json jjSim = BuildJson();
+    std::shared_ptr<IO::Base_IOModel> ioModelPtr(new IO::Base_IOModel(jjSim));
+    // The series of dG0/dtau converges slower than the one of G0, hence more frequencies than the other tests.
+    const GreenMat::GreenCluster0Mat greenCluster0Mat = BuildGreenMat(500);
+    const GreenTau_t greenCluster0TauCubic(greenCluster0Mat, ioModelPtr, 0, 0, GreenTau::Interpolation::CubicHermite);
+    const GreenTau_t greenCluster0TauNonInteractCubic(BuildGreenMatNonInteracting(), ioModelPtr, 0, 0,
+                                                      GreenTau::Interpolation::CubicHermite);
+    ASSERT_EQ(greenCluster0TauCubic.NTau(), static_cast<size_t>(BETA / greenCluster0TauCubic.deltaTauCubic));
+    ASSERT_EQ(GreenTau_t::InterpolationOf(jjSim["solver"]), GreenTau::Interpolation::Linear);
+
+    // Against the exact G0, and against the linear interpolation with 20000 times, with ~160 times fewer.
+    const GreenTau_t greenCluster0Tau(greenCluster0Mat, ioModelPtr, 20000);
+    for (const double tau : {-BETA + 1e-9, -BETA / 3.0, -1e-10, 1e-9, 0.0123, BETA / 2.0, BETA / 1.1167, BETA - 1e-9})
+    {
+        ASSERT_NEAR(greenCluster0TauNonInteractCubic({0, 0}, {0, 0}, tau), greenTau0(MU, ENERGY, tau, BETA), 1e-7);
+        for (size_t ii = 0; ii < Nc; ii++)
+        {
+            ASSERT_NEAR(greenCluster0TauCubic({0, 0}, {ii, 0}, tau), greenCluster0Tau({0, 0}, {ii, 0}, tau), 5e-5);
+        }
+    }
+}
+
+TEST(GreenTauTests, BuildWithFFTAndThreads)
+{
+    Json jjSim = BuildJson();
+    std::shared_ptr<IO::Base_IOModel> ioModelPtr(new IO::Base_IOModel(jjSim));
+    const GreenMat::GreenCluster0Mat greenCluster0Mat = BuildGreenMat(300);
+    const size_t ntau = 1500;
+    const GreenTau_t greenCluster0Tau(greenCluster0Mat, ioModelPtr, ntau, 0, GreenTau::Interpolation::Linear, false, 1);
+    const GreenTau_t greenCluster0TauThreads(greenCluster0Mat, ioModelPtr, ntau, 0, GreenTau::Interpolation::CubicHermite, false, 3);
+
+    // On the times of the table, the values of the FFT are the ones of the direct sums over the frequencies.
+    for (const size_t tt : {size_t(1), size_t(17), ntau / 2, ntau - 1})
+    {
+        const double tau = BETA * static_cast<double>(tt) / static_cast<double>(ntau);
+        for (size_t ii = 0; ii < Nc; ii++)
+        {
+            const double direct = Fourier::MatToTauAnalytic(greenCluster0Mat.tube(0, ii), tau, BETA, greenCluster0Mat.fm()(0, ii).real(),
+                                                            greenCluster0Mat.sm()(0, ii).real(), greenCluster0Mat.tm()(0, ii).real());
+            ASSERT_NEAR(greenCluster0Tau({0, 0}, {ii, 0}, tau), direct, 1e-10);
+            ASSERT_NEAR(greenCluster0TauThreads({0, 0}, {ii, 0}, tau), direct, 1e-10);
+        }
+    }
+}
+
+TEST(GreenTauTests, Cache)
+{
+    Json jjSim = BuildJson();
+    std::shared_ptr<IO::Base_IOModel> ioModelPtr(new IO::Base_IOModel(jjSim));
+    const std::string cacheDir = "gtau_cache_test";
+    boost::filesystem::remove_all(cacheDir);
+
+    // Built and saved, then mapped from the cache, then built again for another NTau.
+    const GreenMat::GreenCluster0Mat greenCluster0Mat = BuildGreenMat();
+    const GreenTau_t greenCluster0Tau(greenCluster0Mat, ioModelPtr, 2000, 0, GreenTau::Interpolation::CubicHermite, true, 1, false,
+                                      cacheDir);
+    ASSERT_EQ(std::distance(boost::filesystem::directory_iterator(cacheDir), boost::filesystem::directory_iterator()), 1);
+    const GreenTau_t greenCluster0TauCached(greenCluster0Mat, ioModelPtr, 2000, 0, GreenTau::Interpolation::CubicHermite, true, 1, false,
+                                            cacheDir);
+    ASSERT_EQ(std::distance(boost::filesystem::directory_iterator(cacheDir), boost::filesystem::directory_iterator()), 1);
+    const GreenTau_t greenCluster0TauOther(greenCluster0Mat, ioModelPtr, 2001, 0, GreenTau::Interpolation::CubicHermite, true, 1, false,
+                                           cacheDir);
+    ASSERT_EQ(std::distance(boost::filesystem::directory_iterator(cacheDir), boost::filesystem::directory_iterator()), 2);
+
+    for (const double tau : {-BETA / 3.0, -1e-10, 0.0123, BETA / 2.0, BETA - 1e-9})
+    {
+        for (size_t ii = 0; ii < Nc; ii++)
+        {
+            ASSERT_DOUBLE_EQ(greenCluster0TauCached({0, 0}, {ii, 0}, tau), greenCluster0Tau({0, 0}, {ii, 0}, tau));
+        }
+    }
+    boost::filesystem::remove_all(cacheDir);
+}
+
+struct TestParts
+{
+    const std::vector<SuperSite_t> &superSites() const { return superSites_; }
+    const std::vector<Tau_t> &taus() const { return taus_; }
+
+    std::vector<SuperSite_t> superSites_;
+    std::vector<Tau_t> taus_;
+};
+
+TEST(GreenTauTests, SinglePrecision)
+{
+    Json jjSim = BuildJson();
+    std::shared_ptr<IO::Base_IOModel> ioModelPtr(new IO::Base_IOModel(jjSim));
+    const size_t ntau = jjSim["solver"]["ntau"];
+    const GreenTau_t greenCluster0TauSingle(BuildGreenMat(), ioModelPtr, ntau, 0, GreenTau::Interpolation::Linear, true);
+    const GreenTau_t greenCluster0TauNonInteractSingle(BuildGreenMatNonInteracting(), ioModelPtr, ntau, 0, GreenTau::Interpolation::Linear,
+                                                       true);
+
+    // |G0| <= 1, so the float table is within 2^-24 ~ 6e-8 of the double one, below the tolerances of the tests above.
+    const GreenTau_t greenCluster0Tau = BuildGreenTau();
+    for (const double tau : {-BETA + 1e-9, -BETA / 3.0, -1e-10, 1e-9, 0.0123, BETA / 2.0, BETA / 1.1167, BETA - 1e-9})
+    {
+        ASSERT_NEAR(greenCluster0TauNonInteractSingle({0, 0}, {0, 0}, tau), greenTau0(MU, ENERGY, tau, BETA), 1e-7);
+        for (size_t ii = 0; ii < Nc; ii++)
+        {
+            ASSERT_NEAR(greenCluster0TauSingle({0, 0}, {ii, 0}, tau), greenCluster0Tau({0, 0}, {ii, 0}, tau), 6e-8);
+        }
+    }
+
+    TestParts parts;
+    for (size_t ii = 0; ii < 2 * Nc; ii++)
+    {
+        parts.superSites_.push_back({ii % Nc, 0});
+        parts.taus_.push_back(BETA * static_cast<double>(ii) / static_cast<double>(2 * Nc + 1));
+    }
+    GreenTau::BatchScratch scratch;
+    std::vector<double> row(parts.taus_.size());
+    greenCluster0TauSingle.EvaluateRowCol({1, 0}, BETA / 5.0, parts, row.size(), scratch, row.data(), nullptr);
+    for (size_t jj = 0; jj < row.size(); jj++)
+    {
+        ASSERT_DOUBLE_EQ(row.at(jj), greenCluster0TauSingle({1, 0}, parts.superSites_.at(jj), BETA / 5.0 - parts.taus_.at(jj)));
+    }
+}
+
+TEST(GreenTauTests, EvaluateRowCol)
+{
+    GreenTau_t greenCluster0Tau = BuildGreenTau();
+
+    TestParts parts;
+    for (size_t ii = 0; ii < 3 * Nc; ii++)
+    {
+        parts.superSites_.push_back({ii % Nc, 0});
+        parts.taus_.push_back(BETA * static_cast<double>(ii) / static_cast<double>(3 * Nc + 1));
+    }
+
+    GreenTau::BatchScratch scratch;
+    const SuperSite_t superSite{2, 0};
+    const Tau_t tau = BETA / 3.0;
+    const size_t kk = parts.taus_.size();
+    std::vector<double> row(kk);
+    std::vector<double> col(kk);
+    greenCluster0Tau.EvaluateRowCol(superSite, tau, parts, kk, scratch, row.data(), col.data());
+
+    for (size_t jj = 0; jj < kk; jj++)
+    {
+        ASSERT_DOUBLE_EQ(row.at(jj), greenCluster0Tau(superSite, parts.superSites_.at(jj), tau - parts.taus_.at(jj)));
+        ASSERT_DOUBLE_EQ(col.at(jj), greenCluster0Tau(parts.superSites_.at(jj), superSite, parts.taus_.at(jj) - tau));
+    }
+}
+
 int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);
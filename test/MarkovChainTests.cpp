@@ -1,6 +1,38 @@
 #include <gtest/gtest.h>
 
 #include "ctmo/ImpuritySolver/MarkovChain.hpp"
+#include "ctmo/MonteCarlo/MonteCarlo.hpp"
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <cerrno>
+
+#ifdef __GLIBC__
+// Count the heap allocations (malloc for new, posix_memalign for armadillo) done while countAllocs is true.
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_memalign(size_t alignment, size_t size);
+
+static bool countAllocs = false;
+static size_t nAllocs = 0;
+
+extern "C" void *malloc(size_t size)
+{
+    if (countAllocs)
+    {
+        nAllocs++;
+    }
+    return __libc_malloc(size);
+}
+
+extern "C" int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    if (countAllocs)
+    {
+        nAllocs++;
+    }
+    *memptr = __libc_memalign(alignment, size);
+    return (*memptr == nullptr) ? ENOMEM : 0;
+}
+#endif
 
 using namespace LinAlg;
 
@@ -9,12 +41,20 @@ const std::string FNAME = "../../test/data/DMFT/params1.json";
 using Model_t = Models::ABC_Model_2D;
 using IOModel_t = IO::Base_IOModel;
 
-Markov::MarkovChain BuildMarkovChain() // for SIAM_Square
+// The parameters of FNAME, with the entries of overrides replaced (merge patch, ex: {"solver": {"kMaxUpd": 16}}).
+Json LoadParams(const Json &overrides = Json::object())
 {
     std::ifstream fin(FNAME);
     Json jj;
     fin >> jj;
     fin.close();
+    jj.merge_patch(overrides);
+    return jj;
+}
+
+Markov::MarkovChain BuildMarkovChain(const size_t &kMaxUpd = 0, const double &probFlip = 0.0) // for SIAM_Square
+{
+    const Json jj = LoadParams({{"solver", {{"kMaxUpd", kMaxUpd}, {"probFlip", probFlip}}}});
     std::cout << "Reading in Json in BuildMarkovChain() " << std::endl;
     const size_t seed = 10224;
     Markov::MarkovChain markovchain(jj, seed);
@@ -80,6 +120,412 @@ TEST(MonteCarloTest, DoStep)
     mc.SaveTherm();
 }
 
+// Do many steps, then compare the N matrices to the ones of a clean update.
+void DoStepsAndCompareToCleanUpdate(Markov::MarkovChain &mc)
+{
+    for (size_t ii = 0; ii < 15000; ii++)
+    {
+        mc.DoStep();
+    }
+
+    const Matrix_t tmpUp = mc.Nup();
+    const Matrix_t tmpDown = mc.Ndown();
+    mc.CleanUpdate();
+
+    for (size_t i = 0; i < tmpUp.n_rows(); i++)
+    {
+        for (size_t j = 0; j < tmpUp.n_rows(); j++)
+        {
+            ASSERT_NEAR(tmpUp(i, j), mc.Nup()(i, j), DELTA);
+        }
+    }
+
+    for (size_t i = 0; i < tmpDown.n_rows(); i++)
+    {
+        for (size_t j = 0; j < tmpDown.n_rows(); j++)
+        {
+            ASSERT_NEAR(tmpDown(i, j), mc.Ndown()(i, j), DELTA);
+        }
+    }
+}
+
+TEST(MonteCarloTest, DoStepDelayed)
+{
+    Markov::MarkovChain mc = BuildMarkovChain(16);
+    DoStepsAndCompareToCleanUpdate(mc);
+}
+
+TEST(MonteCarloTest, DoStepFlips)
+{
+    Markov::MarkovChain mc = BuildMarkovChain(0, 0.3);
+    DoStepsAndCompareToCleanUpdate(mc);
+}
+
+TEST(MonteCarloTest, DoStepFlipsDelayed)
+{
+    Markov::MarkovChain mc = BuildMarkovChain(16, 0.3);
+    DoStepsAndCompareToCleanUpdate(mc);
+}
+
+// The weight of a phonon vertex depends on its aux spin (probProb), the flips must leave it alone: after flips only, the weight
+// of the chain is the one of a fresh build of its configuration.
+TEST(MonteCarloTest, FlipsSkipPhononVertices)
+{
+    const Json jj = LoadParams({{"solver", {{"probFlip", 1.0}}}});
+    Markov::MarkovChain mc(jj, 10224);
+
+    const auto up = static_cast<double>(static_cast<int>(FermionSpin_t::Up));
+    const auto down = static_cast<double>(static_cast<int>(FermionSpin_t::Down));
+    const auto auxUp = static_cast<double>(static_cast<int>(AuxSpin_t::Up));
+    const auto intra = static_cast<double>(static_cast<int>(Diagrammatic::VertexType::HubbardIntra));
+    const auto phonon = static_cast<double>(static_cast<int>(Diagrammatic::VertexType::Phonon));
+    const std::vector<double> configuration = {intra,  3.0,  0.0, up, 0.0, auxUp, 3.0,  0.0, down, 0.0, auxUp,
+                                               phonon, 12.0, 0.0, up, 1.0, auxUp, 11.5, 0.0, down, 0.0, auxUp};
+    mc.SetConfiguration(configuration);
+
+    for (size_t ii = 0; ii < 200; ii++)
+    {
+        mc.DoStep();
+    }
+    mc.CleanUpdate();
+    const std::vector<double> configurationFlipped = mc.Configuration();
+    ASSERT_EQ(configurationFlipped.size(), configuration.size());
+    const size_t phononStart = (configurationFlipped.at(0) == phonon) ? 0 : 11;
+    ASSERT_EQ(configurationFlipped.at(phononStart), phonon);
+    ASSERT_EQ(configurationFlipped.at(phononStart + 5), auxUp);
+    ASSERT_EQ(configurationFlipped.at(phononStart + 10), auxUp);
+
+    Markov::MarkovChain mcFresh(jj, 10225);
+    mcFresh.SetConfiguration(configurationFlipped);
+    ASSERT_NEAR(mc.LogWeight(), mcFresh.LogWeight(), 1e-8);
+}
+
+TEST(MonteCarloTest, CleanUpdateDriftAndLogDeterminant)
+{
+    Markov::MarkovChain mc = BuildMarkovChain(0, 0.3);
+    for (size_t ii = 0; ii < 15000; ii++)
+    {
+        mc.DoStep();
+    }
+
+    const double logDetFast = mc.logDeterminant();
+    mc.CleanUpdate();
+    ASSERT_LT(mc.cleanUpdateDrift(), DELTA);
+    ASSERT_NEAR(logDetFast, mc.logDeterminant(), 1e-6);
+    ASSERT_FALSE(mc.needsCleanUpdate());
+}
+
+TEST(MonteCarloTest, DoStepSharedTables)
+{
+    const Json jj = LoadParams();
+    Markov::MarkovChain mc(jj, 10224);
+    Markov::MarkovChain mcShared(jj, 10225, mc);
+
+    DoStepsAndCompareToCleanUpdate(mcShared);
+    ASSERT_EQ(mc.Nup().n_rows(), size_t(0));
+    DoStepsAndCompareToCleanUpdate(mc);
+}
+
+TEST(MonteCarloTest, DoStepMixedPrecision)
+{
+    const Json jj = LoadParams({{"solver", {{"kMaxUpd", 16}, {"probFlip", 0.3}}}});
+    Markov::MarkovChainT<Markov::AuxHelper_t, float> mc(jj, 10224);
+
+    // The clean updates bring back the N matrices to double precision, the drift in between stays below the bound of the docs.
+    for (size_t ii = 0; ii < 20; ii++)
+    {
+        for (size_t kk = 0; kk < 500; kk++)
+        {
+            mc.DoStep();
+        }
+        mc.CleanUpdate();
+        ASSERT_LT(mc.cleanUpdateDrift(), 1e-3);
+    }
+}
+
+TEST(MonteCarloTest, ReplicaConfiguration)
+{
+    const Json jj = LoadParams();
+    Markov::MarkovChain mc(jj, 10224);
+    for (size_t ii = 0; ii < 5000; ii++)
+    {
+        mc.DoStep();
+    }
+    mc.CleanUpdate();
+    const std::vector<double> configuration = mc.Configuration();
+    const size_t kkUp = mc.Nup().n_rows();
+    const double logDeterminant = mc.logDeterminant();
+    const double logWeight = mc.LogWeight();
+
+    // Setting back its own configuration gives the same weight (the vertex parts can come in another order).
+    mc.SetConfiguration(configuration);
+    ASSERT_EQ(mc.Configuration(), configuration);
+    ASSERT_EQ(mc.Nup().n_rows(), kkUp);
+    ASSERT_NEAR(mc.logDeterminant(), logDeterminant, 1e-8);
+    ASSERT_NEAR(mc.LogWeight(), logWeight, 1e-8);
+
+    // A replica at another U takes the configuration and goes on from it.
+    Json jjReplica = jj;
+    jjReplica["model"]["U"] = jj["model"]["U"].get<double>() + 1.0;
+    Markov::MarkovChain mcReplica(jjReplica, 10225);
+    mcReplica.SetConfiguration(configuration);
+    ASSERT_EQ(mcReplica.Configuration(), configuration);
+    for (size_t ii = 0; ii < 5000; ii++)
+    {
+        mcReplica.DoStep();
+    }
+    mcReplica.CleanUpdate();
+    ASSERT_LT(mcReplica.cleanUpdateDrift(), 1e-6);
+}
+
+TEST(MonteCarloTest, LoadConfiguration)
+{
+    const Json jj = LoadParams();
+    Markov::MarkovChain mc(jj, 10224);
+    for (size_t ii = 0; ii < 5000; ii++)
+    {
+        mc.DoStep();
+    }
+    mc.CleanUpdate();
+    mc.SaveConfiguration("ConfigTest.dat");
+
+    Markov::MarkovChain mcWarm(jj, 10225);
+    ASSERT_FALSE(mcWarm.LoadConfiguration("ConfigDoesNotExist.dat"));
+    ASSERT_TRUE(mcWarm.LoadConfiguration("ConfigTest.dat"));
+    ASSERT_EQ(mcWarm.Configuration(), mc.Configuration());
+    ASSERT_NEAR(mcWarm.LogWeight(), mc.LogWeight(), 1e-8);
+    DoStepsAndCompareToCleanUpdate(mcWarm);
+}
+
+TEST(MonteCarloTest, Checkpoint)
+{
+    const Json jj = LoadParams({{"solver", {{"kMaxUpd", 16}}}});
+    Markov::MarkovChain mc(jj, 10224);
+    for (size_t ii = 0; ii < 5000; ii++)
+    {
+        mc.DoStep();
+        if (ii % 100 == 0)
+        {
+            mc.Measure();
+        }
+    }
+
+    std::stringstream ss;
+    {
+        boost::archive::binary_oarchive ar(ss);
+        mc.SaveCheckpoint(ar);
+    }
+    Markov::MarkovChain mcRestart(jj, 10225);
+    {
+        boost::archive::binary_iarchive ar(ss);
+        mcRestart.LoadCheckpoint(ar);
+    }
+    ASSERT_EQ(mcRestart.Configuration(), mc.Configuration());
+    ASSERT_EQ(mcRestart.updatesProposed(), mc.updatesProposed());
+    ASSERT_DOUBLE_EQ(mcRestart.logDeterminant(), mc.logDeterminant());
+
+    // The random engine is restored too: the restarted chain follows exactly the original one.
+    for (size_t ii = 0; ii < 5000; ii++)
+    {
+        mc.DoStep();
+        mcRestart.DoStep();
+    }
+    ASSERT_EQ(mcRestart.Configuration(), mc.Configuration());
+    ASSERT_DOUBLE_EQ(mcRestart.logDeterminant(), mc.logDeterminant());
+}
+
+// A checkpoint restarts only with the green function measurement it was saved with.
+TEST(MonteCarloTest, CheckpointMeasurementMode)
+{
+    std::vector<std::string> checkpoints;
+    for (const size_t nLegendre : {0, 20})
+    {
+        Markov::MarkovChain mc(LoadParams({{"solver", {{"nLegendre", nLegendre}}}}), 10224);
+        for (size_t ii = 0; ii < 1000; ii++)
+        {
+            mc.DoStep();
+        }
+        mc.Measure();
+        std::stringstream ss;
+        {
+            boost::archive::binary_oarchive ar(ss);
+            mc.SaveCheckpoint(ar);
+        }
+        checkpoints.push_back(ss.str());
+    }
+
+    for (const size_t nLegendre : {0, 20, 30})
+    {
+        Markov::MarkovChain mcRestart(LoadParams({{"solver", {{"nLegendre", nLegendre}}}}), 10225);
+        for (size_t ii = 0; ii < checkpoints.size(); ii++)
+        {
+            std::stringstream ss(checkpoints.at(ii));
+            boost::archive::binary_iarchive ar(ss);
+            if (nLegendre == 20 * ii)
+            {
+                ASSERT_NO_THROW(mcRestart.LoadCheckpoint(ar));
+            }
+            else
+            {
+                ASSERT_THROW(mcRestart.LoadCheckpoint(ar), std::runtime_error);
+            }
+        }
+    }
+}
+
+TEST(MonteCarloTest, AutocorrelationTime)
+{
+    Utilities::EngineTypeMt19937_t rng(10224);
+    Utilities::UniformRngMt19937_t urng(rng, Utilities::UniformDistribution_t(-0.5, 0.5));
+    MC::BinningAnalysis uncorrelated;
+    MC::BinningAnalysis correlated;
+    MC::BinningAnalysis constant;
+
+    // x_t = a x_{t-1} + noise has tau = (1 + a) / (2 (1 - a)).
+    const double aa = 0.8;
+    double xx = 0.0;
+    for (size_t ii = 0; ii < (size_t(1) << 18); ii++)
+    {
+        const double noise = urng();
+        xx = aa * xx + noise;
+        uncorrelated.Add(noise);
+        correlated.Add(xx);
+        constant.Add(1.0);
+    }
+    ASSERT_NEAR(uncorrelated.AutocorrelationTime(), 0.5, 0.1);
+    ASSERT_NEAR(correlated.AutocorrelationTime(), 0.5 * (1.0 + aa) / (1.0 - aa), 0.5);
+    ASSERT_DOUBLE_EQ(constant.AutocorrelationTime(), 0.0);
+}
+
+TEST(MonteCarloTest, StandardError)
+{
+    Utilities::EngineTypeMt19937_t rng(10224);
+    Utilities::UniformRngMt19937_t urng(rng, Utilities::UniformDistribution_t(-0.5, 0.5));
+    MC::BinningAnalysis correlated;
+
+    // var(x) = var(noise) / (1 - a^2) = 1 / (12 (1 - a^2)), and the error of the mean is sqrt(2 tau var / N).
+    const double aa = 0.8;
+    const size_t NN = size_t(1) << 18;
+    double xx = 0.0;
+    for (size_t ii = 0; ii < NN; ii++)
+    {
+        xx = aa * xx + urng();
+        correlated.Add(xx);
+    }
+    const double expected = std::sqrt((1.0 + aa) / (1.0 - aa) / (12.0 * (1.0 - aa * aa)) / static_cast<double>(NN));
+    ASSERT_NEAR(correlated.StandardError(), expected, 0.15 * expected);
+    ASSERT_NEAR(correlated.Mean(), 0.0, 4.0 * expected);
+}
+
+struct ScalarsChain
+{
+    std::array<double, 4> MeasuredScalars() const { return scalars; }
+    std::array<double, 4> scalars;
+};
+
+TEST(MonteCarloTest, AccuracyTarget)
+{
+    Utilities::EngineTypeMt19937_t rng(10225);
+    Utilities::UniformRngMt19937_t urng(rng, Utilities::UniformDistribution_t(-0.5, 0.5));
+    const Json jjMonteCarlo = {{"targetError", 0.01}};
+    MC::AccuracyTarget accuracyTarget(jjMonteCarlo);
+    ASSERT_TRUE(accuracyTarget.IsEnabled());
+    ASSERT_FALSE(MC::AccuracyTarget(Json::object()).IsEnabled());
+
+    // Uncorrelated: one sign out of ten is negative, <sign> = 0.8 with the relative error sqrt(0.36 / N) / 0.8. The filling has
+    // about the same one, the ratio <sign n> / <sign> adds both in quadrature. The double occupancy (0) is not measured.
+    const size_t NN = 20000;
+    ScalarsChain chain{};
+    for (size_t ii = 0; ii < NN; ii++)
+    {
+        const double sign = (ii % 10 == 0) ? -1.0 : 1.0;
+        chain.scalars = {sign, sign * (50.0 + urng()), sign * (1.0 + 0.1 * urng()), 0.0};
+        accuracyTarget.Record(chain);
+    }
+    const double relativeSign = std::sqrt(0.36 / static_cast<double>(NN)) / 0.8;
+    ASSERT_NEAR(accuracyTarget.RelativeError(), std::sqrt(2.0) * relativeSign, 0.1 * relativeSign);
+
+    // The time is only looked at on the checks. The last check is at the end of the time, and the time over ends the measurements
+    // whatever the errors.
+    MC::Timer timer;
+    timer.Start(-1.0);
+    ASSERT_FALSE(accuracyTarget.IsDone(timer));
+    accuracyTarget.Start(timer);
+    ASSERT_TRUE(accuracyTarget.IsDone(timer));
+
+    // Kept by the checkpoints: the restarted target has the errors of all the measurements.
+    std::stringstream ss;
+    {
+        boost::archive::binary_oarchive ar(ss);
+        ar << accuracyTarget;
+    }
+    MC::AccuracyTarget accuracyTargetRestart(jjMonteCarlo);
+    {
+        boost::archive::binary_iarchive ar(ss);
+        ar >> accuracyTargetRestart;
+    }
+    ASSERT_DOUBLE_EQ(accuracyTargetRestart.RelativeError(), accuracyTarget.RelativeError());
+}
+
+#ifdef __GLIBC__
+// Once the scratch memory has grown to the biggest expansion order, the steps should not allocate anymore.
+void AssertNoAllocationsAtSteadyState(Markov::MarkovChain &mc)
+{
+    for (size_t ii = 0; ii < 50000; ii++)
+    {
+        mc.DoStep();
+    }
+
+    nAllocs = 0;
+    countAllocs = true;
+    for (size_t ii = 0; ii < 1000; ii++)
+    {
+        mc.DoStep();
+    }
+    countAllocs = false;
+    ASSERT_EQ(nAllocs, size_t(0));
+}
+
+// The hooks see the allocations of LinAlg::Matrix: growing its capacity is counted.
+TEST(MonteCarloTest, CountsMatrixReallocations)
+{
+    LinAlg::Matrix<double> mat(4, 4);
+    nAllocs = 0;
+    countAllocs = true;
+    mat.SetSize(200, 200);
+    countAllocs = false;
+    ASSERT_GT(nAllocs, size_t(0));
+}
+
+TEST(MonteCarloTest, DoStepNoAllocations)
+{
+    Markov::MarkovChain mc = BuildMarkovChain();
+    AssertNoAllocationsAtSteadyState(mc);
+}
+
+TEST(MonteCarloTest, DoStepNoAllocationsDelayedFlips)
+{
+    Markov::MarkovChain mc = BuildMarkovChain(16, 0.3);
+    AssertNoAllocationsAtSteadyState(mc);
+}
+
+// UPrime != J_H gives a weight to the same-spin interorbital vertices, their insertions go through the 2x2 blocks.
+TEST(MonteCarloTest, DoStepNoAllocationsSameSpin)
+{
+    Markov::MarkovChain mc(LoadParams({{"model", {{"UPrime", 2.0}}}}), 10224);
+    AssertNoAllocationsAtSteadyState(mc);
+
+    const auto interSpin = static_cast<double>(static_cast<int>(Diagrammatic::VertexType::HubbardInterSpin));
+    const std::vector<double> configuration = mc.Configuration();
+    size_t nInterSpin = 0;
+    for (size_t ii = 0; ii < configuration.size(); ii += 11)
+    {
+        nInterSpin += (configuration.at(ii) == interSpin) ? 1 : 0;
+    }
+    ASSERT_GT(nInterSpin, size_t(0));
+}
+#endif
+
 int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);
@@ -2,6 +2,7 @@
 
 #include <gtest/gtest.h>
 #include "ctmo/Foundations/Matrix.hpp"
+#include <cstdint>
 
 using namespace LinAlg;
 using cd_t = std::complex<double>;
@@ -193,6 +194,45 @@ TEST(MatrixTest, SubMat_T)
     a.Print();
 }
 
+TEST(MatrixTest, AlignedGrowthAndSwapRemoval)
+{
+    Matrix<double> m1(3, 3);
+    for (size_t ii = 0; ii < 3; ii++)
+    {
+        for (size_t jj = 0; jj < 3; jj++)
+        {
+            m1(ii, jj) = 10.0 * ii + jj;
+        }
+    }
+    ASSERT_EQ(reinterpret_cast<std::uintptr_t>(m1.memptr()) % Matrix<double>::ALIGNMENT, 0);
+    ASSERT_EQ(m1.mem_n_rows() * sizeof(double) % Matrix<double>::ALIGNMENT, 0);
+
+    // Within the capacity the memory does not move, past it the live block is kept.
+    const double *mem = m1.memptr();
+    m1.Resize(4, 4);
+    ASSERT_EQ(m1.memptr(), mem);
+    m1.Resize(300, 300);
+    ASSERT_EQ(reinterpret_cast<std::uintptr_t>(m1.memptr()) % Matrix<double>::ALIGNMENT, 0);
+    ASSERT_EQ(m1.mem_n_rows() * sizeof(double) % Matrix<double>::ALIGNMENT, 0);
+    ASSERT_DOUBLE_EQ(m1(2, 1), 21.0);
+    ASSERT_DOUBLE_EQ(m1(1, 2), 12.0);
+    m1.Resize(3, 3);
+
+    Matrix<double> m2(m1);
+    m2.SwapRowsAndCols(0, 2);
+    ASSERT_DOUBLE_EQ(m2(0, 0), 22.0);
+    ASSERT_DOUBLE_EQ(m2(0, 2), 20.0);
+    ASSERT_DOUBLE_EQ(m2(2, 0), 2.0);
+    ASSERT_DOUBLE_EQ(m2(1, 1), 11.0);
+
+    m1.ShedRowAndCol(0);
+    ASSERT_EQ(m1.n_rows(), 2);
+    ASSERT_DOUBLE_EQ(m1(0, 0), 11.0);
+    ASSERT_DOUBLE_EQ(m1(1, 0), 21.0);
+    ASSERT_DOUBLE_EQ(m1(0, 1), 12.0);
+    ASSERT_DOUBLE_EQ(m1(1, 1), 22.0);
+}
+
 int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);
@@ -3,6 +3,7 @@
 #include <gtest/gtest.h>
 #include "ctmo/Foundations/Utilities.hpp"
 #include "ctmo/Foundations/LinAlg.hpp"
+#include "ctmo/Foundations/DelayedUpdate.hpp"
 
 using namespace Utilities;
 using namespace LinAlg;
@@ -529,6 +530,48 @@ TEST(UtilitiesTest, BlockRankTwoDownGrade)
     }
 }
 
+TEST(UtilitiesTest, BlockRankTwoUpgradeThenDowngrade)
+{
+    // The rank-two updates work in the memory of the N matrix, test them for sizes around the capacity of Matrix.
+    for (const size_t kk : {1, 7, 16, 40})
+    {
+        ClusterMatrix_t a2(kk + 2, kk + 2);
+        a2.randu();
+        a2.diag() += 3.0;
+        const ClusterMatrix_t a1 = a2.submat(0, 0, kk - 1, kk - 1);
+        const ClusterMatrix_t m2Good = a2.i();
+
+        Matrix_t m1Matrix(ClusterMatrix_t(a1.i()));
+        const Matrix_t Q(ClusterMatrix_t(a2.submat(0, kk, kk - 1, kk + 1)));
+        const Matrix_t R(ClusterMatrix_t(a2.submat(kk, 0, kk + 1, kk - 1)));
+        const Matrix_t STilde(ClusterMatrix_t(m2Good.submat(kk, kk, kk + 1, kk + 1)));
+        Matrix_t NQ(kk, 2);
+        DGEMM(1.0, 0.0, m1Matrix, Q, NQ);
+
+        BlockWorkspace workspace;
+        BlockRankTwoUpgrade(m1Matrix, NQ, R, STilde, workspace);
+        ASSERT_EQ(m1Matrix.n_rows(), kk + 2);
+        for (size_t i = 0; i < kk + 2; i++)
+        {
+            for (size_t j = 0; j < kk + 2; j++)
+            {
+                ASSERT_NEAR(m1Matrix(i, j), m2Good(i, j), DELTA);
+            }
+        }
+
+        BlockRankTwoDowngrade(m1Matrix);
+        const ClusterMatrix_t m1Good = a1.i();
+        ASSERT_EQ(m1Matrix.n_rows(), kk);
+        for (size_t i = 0; i < kk; i++)
+        {
+            for (size_t j = 0; j < kk; j++)
+            {
+                ASSERT_NEAR(m1Matrix(i, j), m1Good(i, j), DELTA);
+            }
+        }
+    }
+}
+
 TEST(UtilitiesTest, BlockRankDownGradeVers2)
 {
     const size_t kk = 40;
@@ -598,6 +641,111 @@ TEST(UtilitiesTest, DotRank2)
     }
 }
 
+TEST(UtilitiesTest, DelayedRankOne)
+{
+    // Grow and shrink the inverse of a1 with the delayed updates and compare to the direct inversion.
+    const size_t kk = 12;
+    ClusterMatrix_t a1(kk, kk);
+    a1.randu();
+    a1.diag() += 4.0;
+
+    ClusterMatrix_t m1 = a1.i();
+    Matrix_t direct(m1);
+    Matrix_t delayed(direct);
+    DelayedRankOne delayedRankOne(8);
+
+    const std::vector<size_t> removeAt = {3, 0, 7};
+    for (size_t step = 0; step < 3; step++)
+    {
+        const size_t kkOld = direct.n_rows();
+        SiteVector_t Q(kkOld);
+        Q.randu();
+        SiteVector_t R(kkOld);
+        R.randu();
+        const double S = 4.5;
+
+        SiteVector_t mkQ(kkOld);
+        delayedRankOne.MatrixVectorMult(delayed, Q, mkQ);
+        const double STilde = 1.0 / (S - DotVectors(R, mkQ));
+        delayedRankOne.Upgrade(delayed, mkQ, R, STilde);
+
+        SiteVector_t mkQDirect(kkOld);
+        MatrixVectorMult(direct, Q, 1.0, mkQDirect);
+        BlockRankOneUpgrade(direct, mkQDirect, R, 1.0 / (S - DotVectors(R, mkQDirect)));
+
+        const size_t pp = removeAt.at(step);
+        delayedRankOne.Downgrade(delayed, pp);
+        BlockRankOneDowngrade(direct, pp);
+    }
+
+    ASSERT_EQ(delayedRankOne.nPending(), size_t(6));
+    const Matrix_t materialized = delayedRankOne.Materialize(delayed);
+    delayedRankOne.Flush(delayed);
+    ASSERT_EQ(delayedRankOne.nPending(), size_t(0));
+    ASSERT_EQ(delayed.n_rows(), direct.n_rows());
+
+    for (size_t i = 0; i < direct.n_rows(); i++)
+    {
+        for (size_t j = 0; j < direct.n_cols(); j++)
+        {
+            ASSERT_NEAR(materialized(i, j), direct(i, j), DELTA);
+            ASSERT_NEAR(delayed(i, j), direct(i, j), DELTA);
+        }
+    }
+}
+
+TEST(UtilitiesTest, MixedPrecisionRankOne)
+{
+    // Same as above, the single precision matrices are compared to the double precision ones.
+    const double deltaFloat = 1e-5;
+    const size_t kk = 12;
+    ClusterMatrix_t a1(kk, kk);
+    a1.randu();
+    a1.diag() += 4.0;
+
+    ClusterMatrix_t m1 = a1.i();
+    Matrix_t direct(m1);
+    Matrix<float> directFloat;
+    directFloat.CopyFrom(direct);
+    Matrix<float> delayedFloat(directFloat);
+    DelayedRankOneT<float> delayedRankOne(8);
+    BlockWorkspaceT<float> workspace;
+
+    const std::vector<size_t> removeAt = {3, 0, 7};
+    for (size_t step = 0; step < 3; step++)
+    {
+        const size_t kkOld = direct.n_rows();
+        SiteVector_t Q(kkOld);
+        Q.randu();
+        SiteVector_t R(kkOld);
+        R.randu();
+        const double S = 4.5;
+
+        SiteVector_t mkQ(kkOld);
+        MatrixVectorMult(direct, Q, 1.0, mkQ);
+        BlockRankOneUpgrade(direct, mkQ, R, 1.0 / (S - DotVectors(R, mkQ)));
+
+        SiteVector_t mkQFloat(kkOld);
+        delayedRankOne.MatrixVectorMult(directFloat, Q, mkQFloat);
+        BlockRankOneUpgrade(directFloat, mkQFloat, R, 1.0 / (S - DotVectors(R, mkQFloat)), workspace);
+
+        delayedRankOne.MatrixVectorMult(delayedFloat, Q, mkQFloat);
+        delayedRankOne.Upgrade(delayedFloat, mkQFloat, R, 1.0 / (S - DotVectors(R, mkQFloat)));
+
+        const size_t pp = removeAt.at(step);
+        BlockRankOneDowngrade(direct, pp);
+        BlockRankOneDowngrade(directFloat, pp, workspace);
+        delayedRankOne.Downgrade(delayedFloat, pp);
+    }
+
+    delayedRankOne.Flush(delayedFloat);
+    ASSERT_EQ(directFloat.n_rows(), direct.n_rows());
+    ASSERT_EQ(delayedFloat.n_rows(), direct.n_rows());
+    ASSERT_LT(directFloat.MaxAbsDiff(direct), deltaFloat);
+    ASSERT_LT(delayedFloat.MaxAbsDiff(direct), deltaFloat);
+    ASSERT_GT(directFloat.MaxAbsDiff(direct), 0.0);
+}
+
 // TEST(UtilitiesTest, AddOneElementToInverse)
 // {
 //     ClusterMatrix_t a1 = {
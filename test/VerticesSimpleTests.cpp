@@ -2,6 +2,7 @@
 
 #include <gtest/gtest.h>
 #include "ctmo/ImpuritySolver/VerticesSimple.hpp"
+#include "ctmo/ImpuritySolver/ConfigSnapshot.hpp"
 #include "TestTools.hpp"
 
 const double DELTA_SMALL = 1e-11;
@@ -180,6 +181,144 @@ TEST(VerticesTests, VertexInit)
     ASSERT_TRUE((vecVertex.at(1).vStart() == v2.vStart()));
 }
 
+TEST(VerticesTests, PartIndexAfterRemovals)
+{
+    using namespace Diagrammatic;
+    Vertices vertices;
+
+    // Vertex ii has tau = ii, one part of each spin when ii is even, two parts of spin ii % 4 == 1 ? up : down otherwise.
+    const size_t kk = 12;
+    for (size_t ii = 0; ii < kk; ii++)
+    {
+        const Tau_t tau = static_cast<double>(ii);
+        const FermionSpin_t spinStart = (ii % 4 == 3) ? FermionSpin_t::Down : FermionSpin_t::Up;
+        const FermionSpin_t spinEnd = (ii % 4 == 1) ? FermionSpin_t::Up : FermionSpin_t::Down;
+        const VertexType vtype = (spinStart == spinEnd) ? VertexType::HubbardInterSpin : VertexType::HubbardIntra;
+        const VertexPart vStart(vtype, tau, ii % 4, spinStart, 0, AuxSpin_t::Up);
+        const VertexPart vEnd(vtype, tau, ii % 4, spinEnd, 1, AuxSpin_t::Up);
+        vertices.AppendVertex(Vertex(vtype, vStart, vEnd, 1.0));
+    }
+
+    // Remove as the markov chain does: the parts are swapped with the last ones of their spin, then the vertex is removed.
+    for (const size_t pp : {3, 0, 5, 1})
+    {
+        const Vertex vertex = vertices.at(pp);
+        const FermionSpin_t spinStart = vertex.vStart().spin();
+        const FermionSpin_t spinEnd = vertex.vEnd().spin();
+        const size_t ppEnd = vertices.PartIndex(pp, true);
+        vertices.SwapVertexPart(ppEnd, vertices.parts(spinEnd).size() - 1, spinEnd);
+        const size_t ppStart = vertices.PartIndex(pp, false);
+        const size_t kkStart = vertices.parts(spinStart).size() - ((spinStart == spinEnd) ? 2 : 1);
+        vertices.SwapVertexPart(ppStart, kkStart, spinStart);
+        vertices.RemoveVertex(pp);
+        vertices.PopBackVertexPart(spinEnd);
+        vertices.PopBackVertexPart(spinStart);
+        vertices.AssertSizes();
+    }
+
+    ASSERT_EQ(vertices.size(), kk - 4);
+    for (size_t pp = 0; pp < vertices.size(); pp++)
+    {
+        const Vertex &vertex = vertices.at(pp);
+        const VertexPartStore &partsStart = vertices.parts(vertex.vStart().spin());
+        const VertexPartStore &partsEnd = vertices.parts(vertex.vEnd().spin());
+        ASSERT_TRUE(partsStart[vertices.PartIndex(pp, false)] == vertex.vStart());
+        ASSERT_TRUE(partsEnd[vertices.PartIndex(pp, true)] == vertex.vEnd());
+        ASSERT_DOUBLE_EQ(partsStart.taus().at(vertices.PartIndex(pp, false)), vertex.vStart().tau());
+        ASSERT_TRUE((partsEnd.superSites().at(vertices.PartIndex(pp, true)) == vertex.vEnd().superSite()));
+        if (vertex.vStart().spin() != vertex.vEnd().spin())
+        {
+            ASSERT_EQ(vertices.PartIndex(pp, FermionSpin_t::Up), vertices.PartIndex(pp, false));
+        }
+    }
+}
+
+TEST(VerticesTests, ConfigSnapshot)
+{
+    using namespace Diagrammatic;
+    Vertices vertices;
+    const size_t kk = 20;
+    for (size_t ii = 0; ii < kk; ii++)
+    {
+        const Tau_t tau = 0.37 * static_cast<double>(ii);
+        const FermionSpin_t spinEnd = (ii % 3 == 0) ? FermionSpin_t::Up : FermionSpin_t::Down;
+        const VertexType vtype = (spinEnd == FermionSpin_t::Up) ? VertexType::HubbardIntra : VertexType::HubbardInterSpin;
+        const AuxSpin_t aux = (ii % 2 == 0) ? AuxSpin_t::Up : AuxSpin_t::Down;
+        const VertexPart vStart(vtype, tau, ii % 4, FermionSpin_t::Up, ii % 2, aux);
+        const VertexPart vEnd(vtype, tau + 0.5, ii % 4, spinEnd, 1, aux);
+        vertices.AppendVertex(Vertex(vtype, vStart, vEnd, 1.0));
+    }
+
+    ConfigSnapshot::Header header;
+    header.modelHash = ConfigSnapshot::Hash("{\"U\": 6.0}");
+    header.beta = 10.0;
+    header.Nc = 4;
+    header.NOrb = 2;
+
+    for (const bool isCompressed : {false, true})
+    {
+        std::stringstream ss;
+        ConfigSnapshot::Write(ss, header, vertices, isCompressed);
+
+        ConfigSnapshot::Header headerRead;
+        std::vector<std::pair<VertexPart, VertexPart>> parts;
+        ASSERT_TRUE(ConfigSnapshot::Read(ss, headerRead, parts));
+        ASSERT_EQ(headerRead.modelHash, header.modelHash);
+        ASSERT_DOUBLE_EQ(headerRead.beta, header.beta);
+        ASSERT_EQ(headerRead.Nc, header.Nc);
+        ASSERT_EQ(headerRead.NOrb, header.NOrb);
+        ASSERT_EQ(parts.size(), kk);
+        for (size_t ii = 0; ii < kk; ii++)
+        {
+            ASSERT_TRUE(parts.at(ii).first == vertices.at(ii).vStart());
+            ASSERT_TRUE(parts.at(ii).second == vertices.at(ii).vEnd());
+            ASSERT_DOUBLE_EQ(parts.at(ii).second.tau(), vertices.at(ii).vEnd().tau());
+            ASSERT_EQ(parts.at(ii).first.vtype(), vertices.at(ii).vtype());
+            ASSERT_EQ(parts.at(ii).first.aux(), vertices.at(ii).vStart().aux());
+        }
+
+        // Truncated or not a snapshot.
+        const std::string bytes = ss.str();
+        std::stringstream truncated(bytes.substr(0, bytes.size() - 1));
+        ASSERT_FALSE(ConfigSnapshot::Read(truncated, headerRead, parts));
+        std::stringstream text("0 1 0.5 0 1 0 0\n");
+        ASSERT_FALSE(ConfigSnapshot::Read(text, headerRead, parts));
+    }
+
+    // Corrupted: the sizes of the header (number of vertices, then size of the records, the last 16 bytes of the 64 of the header)
+    // are checked before the allocation, the bytes of the enums (at 24 in the first record) against their ranges.
+    std::stringstream ss;
+    ConfigSnapshot::Write(ss, header, vertices, false);
+    const std::string bytes = ss.str();
+    const std::uint64_t huge = std::uint64_t(1) << 62;
+    for (const size_t offset : {size_t(48), size_t(56)})
+    {
+        std::string corrupted = bytes;
+        std::memcpy(&corrupted[offset], &huge, sizeof(huge));
+        std::stringstream in(corrupted);
+        ConfigSnapshot::Header headerRead;
+        std::vector<std::pair<VertexPart, VertexPart>> parts;
+        ASSERT_FALSE(ConfigSnapshot::Read(in, headerRead, parts));
+    }
+    for (const size_t offset : {size_t(64 + 24), size_t(64 + 25), size_t(64 + 26), size_t(64 + 27)})
+    {
+        std::string corrupted = bytes;
+        corrupted[offset] = static_cast<char>(100);
+        std::stringstream in(corrupted);
+        ConfigSnapshot::Header headerRead;
+        std::vector<std::pair<VertexPart, VertexPart>> parts;
+        ASSERT_FALSE(ConfigSnapshot::Read(in, headerRead, parts));
+    }
+
+    // Saved through a temporary file.
+    ConfigSnapshot::Save("ConfigSnapshotTest.bin", header, vertices, true);
+    ASSERT_FALSE(std::ifstream("ConfigSnapshotTest.bin.tmp").good());
+    ConfigSnapshot::Header headerLoaded;
+    std::vector<std::pair<VertexPart, VertexPart>> partsLoaded;
+    ASSERT_TRUE(ConfigSnapshot::Load("ConfigSnapshotTest.bin", headerLoaded, partsLoaded));
+    ASSERT_EQ(partsLoaded.size(), kk);
+}
+
 // TEST(Vertices2DTest, InitVertices)
 // {
 //     std::ifstream fin(FNAME);
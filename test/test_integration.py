@@ -150,6 +150,48 @@ class TestIntegration(unittest.TestCase):
                 jj_result[key][0], jj_good[key][0], rtol=1e-3, atol=1e-3
             )
 
+    def test_dca2x2_mixed_precision(self):
+        # Same run as test_dca2x2, in double and in mixed precision (solver.mixedPrecision, the N matrices in float
+        # between the clean updates). The differences must stay within the tolerances of test_dca2x2 (statistical).
+        base_path = os.getcwd()
+        dca2x2_path = os.path.join(base_path, "test/Simulations/2x2_DCA_b5_U3")
+        results = {}
+        for mixed_precision in [False, True]:
+            name = "mixed" if mixed_precision else "double"
+            tmp_path = os.path.join(base_path, "tmp/2x2_DCA_b5_U3_" + name)
+            shutil.rmtree(tmp_path, ignore_errors=True)
+            shutil.copytree(dca2x2_path, tmp_path)
+            os.chdir(tmp_path)
+
+            with open("params1.json") as fin:
+                jj_params = json.load(fin)
+            jj_params["solver"]["mixedPrecision"] = mixed_precision
+            jj_params["solver"]["cleanUpdateTolerance"] = 1e-4
+            with open("params1.json", "w") as fout:
+                json.dump(jj_params, fout, indent=4)
+
+            subprocess.run(self.mpi_dca_cmd, shell=True)
+            with open("Obs.json") as fin:
+                jj_result = json.load(fin)
+            results[name] = (np.loadtxt("selfUp1.dat"), np.loadtxt("greenUp1.dat"), jj_result)
+            os.chdir(base_path)
+
+        self_double, green_double, jj_double = results["double"]
+        self_mixed, green_mixed, jj_mixed = results["mixed"]
+        print("mixed - double, max |self|: ", np.max(np.abs(self_mixed[:, 1:] - self_double[:, 1:])))
+        for key in ["docc", "n", "sign", "k"]:
+            print(
+                "mixed - double, %s: %g (errors %g, %g)"
+                % (key, jj_mixed[key][0] - jj_double[key][0], jj_mixed[key][1], jj_double[key][1])
+            )
+
+        np.testing.assert_allclose(green_mixed, green_double, rtol=4e-3, atol=1e-3)
+        np.testing.assert_allclose(self_mixed, self_double, rtol=4e-3, atol=4e-3)
+        for key in ["docc", "n", "sign", "k"]:
+            np.testing.assert_allclose(
+                jj_mixed[key][0], jj_double[key][0], rtol=1e-3, atol=1e-3
+            )
+
     def test_dca4x4(self):
         base_path = os.getcwd()
         dca4x4_path = os.path.join(base_path, "test/Simulations/4x4_DCA_b10_U3")